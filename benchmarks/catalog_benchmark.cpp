@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include <boost/format.hpp>
+
+#include "tests/fixture.hpp"
+
+constexpr auto rounds = 4u;
+constexpr std::size_t files_per_commit = 100;
+constexpr auto repetitions = 5;
+
+// measures catalog generation for upgrades with many scripts: every round commits each path once, deletes every tenth
+// one again and tags the head, so the oldest upgrade carries all paths, each changed in every round
+int main()
+{
+	const temp_db db{"kitman_catalog_benchmark.db"};
+
+	std::cout << boost::format("%1$10s %2$10s %3$14s\n") % "paths" % "upgrades" % "ms/catalog";
+
+	for(const auto path_count : {100u, 1000u, 10000u})
+	{
+		db.remove();
+
+		std::vector<std::string> paths;
+
+		{
+			auto kitman = open_kitman(db);
+
+			create_main_stream(kitman);
+
+			const auto &files = make_files(kitman, path_count);
+
+			for(auto round = 1u; round <= rounds; ++round)
+			{
+				for(std::size_t first = 0; first < files.size(); first += files_per_commit)
+				{
+					const auto last = std::min(files.size(), first + files_per_commit);
+
+					kitman.commit_files("main", "commit", {files.cbegin() + first, files.cbegin() + last});
+				}
+
+				std::vector<file> deletes;
+
+				for(auto i = round; i < path_count; i += 10)
+				{
+					deletes.emplace_back(files[i].path, true);
+				}
+
+				kitman.commit_files("main", "delete", deletes);
+				kitman.create_tag("main", (boost::format("1.%1%.0") % round).str());
+			}
+
+			paths = kitman.get_paths("main");
+		}
+
+		std::chrono::duration<double, std::milli> elapsed{};
+		std::size_t upgrade_count = 0;
+
+		// a new kitman for every run, so no catalog comes from the cache
+		for(auto i = 0; i < repetitions; ++i)
+		{
+			auto kitman = open_kitman(db);
+
+			auto catalog_paths = paths;
+
+			const auto start = std::chrono::steady_clock::now();
+			const auto &catalog = kitman.get_catalog("main", catalog_paths);
+
+			elapsed += std::chrono::steady_clock::now() - start;
+			upgrade_count = catalog->size();
+		}
+
+		std::cout << boost::format("%1$10d %2$10d %3$14.2f\n") % path_count % upgrade_count % (elapsed.count() / repetitions);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,44 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include <boost/format.hpp>
+
+#include "tests/fixture.hpp"
+
+// each size is committed until at least this many files went in, so small commits get enough rounds to time
+constexpr auto min_total_files = 200000u;
+
+// measures kitman::commit_files for commits of 10, 1000 and 100000 files, each size on a fresh database
+int main()
+{
+	const temp_db db{"kitman_commit_files_benchmark.db"};
+
+	std::cout << boost::format("%1$10s %2$8s %3$12s %4$14s\n") % "files" % "commits" % "seconds" % "files/second";
+
+	for(const auto file_count : {10u, 1000u, 100000u})
+	{
+		db.remove();
+
+		auto kitman = open_kitman(db);
+
+		create_main_stream(kitman);
+
+		const auto &files = make_files(kitman, file_count);
+
+		const auto commit_count = std::max(1u, min_total_files / file_count);
+		const auto start = std::chrono::steady_clock::now();
+
+		for(auto i = 0u; i < commit_count; ++i)
+		{
+			kitman.commit_files("main", "commit", files);
+		}
+
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::cout << boost::format("%1$10d %2$8d %3$12.3f %4$14.0f\n") % file_count % commit_count % elapsed.count() % (file_count * commit_count / elapsed.count());
+	}
+
+	return EXIT_SUCCESS;
+}
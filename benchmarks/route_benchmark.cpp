@@ -0,0 +1,145 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <regex>
+#include <string_view>
+#include <tuple>
+
+#include <boost/format.hpp>
+
+#include "route.hpp"
+
+constexpr auto rounds = 100000;
+
+// the routes as http_session had them with std::regex, matched against the whole target including the query string
+const std::tuple<std::string_view, std::regex> regex_routes[]
+{
+	{"POST", std::regex{"/streams/([^/]+)/commits"}},
+	{"POST", std::regex{"/streams"}},
+	{"POST", std::regex{"/streams/([^/]+)/tags"}},
+	{"DELETE", std::regex{"/streams/([^/]+)"}},
+	{"GET", std::regex{"/streams/([^/]+)/catalog(\\?.*)?"}},
+	{"GET", std::regex{"/streams/([^/]+)/commits(\\?.*)?"}},
+	{"GET", std::regex{"/streams/([^/]+)/paths"}},
+	{"GET", std::regex{"/streams"}},
+	{"POST", std::regex{"/streams/([^/]+)/merge"}}
+};
+
+// the same routes as http_session::routes_ has them now
+const std::tuple<std::string_view, std::string_view> segment_routes[]
+{
+	{"POST", "/streams/{stream}/commits"},
+	{"POST", "/streams"},
+	{"POST", "/streams/{stream}/tags"},
+	{"DELETE", "/streams/{stream}"},
+	{"GET", "/streams/{stream}/catalog"},
+	{"GET", "/streams/{stream}/commits"},
+	{"GET", "/streams/{stream}/paths"},
+	{"GET", "/streams"},
+	{"POST", "/streams/{stream}/merge"}
+};
+
+// what the web client sends, and targets no route takes that fall through to the static files; queries only where both
+// routers accept them, so their results can be compared
+const std::tuple<std::string_view, std::string_view> requests[]
+{
+	{"GET", "/streams"},
+	{"GET", "/streams/main/catalog"},
+	{"GET", "/streams/main/catalog?paths=1.0.0,1.1.0,1.2.0"},
+	{"GET", "/streams/feature-x/commits?sort=comment&order=asc&page=2&page_size=50"},
+	{"GET", "/streams/release/commits?after=1234&page_size=100"},
+	{"GET", "/streams/main/paths"},
+	{"POST", "/streams"},
+	{"POST", "/streams/main/commits"},
+	{"POST", "/streams/release/tags"},
+	{"POST", "/streams/main/merge"},
+	{"DELETE", "/streams/feature-x"},
+	{"GET", "/index.html"},
+	{"GET", "/static/js/main.js"}
+};
+
+// index of the matched route, or -1, and the stream it extracted
+static std::tuple<int, std::string_view> match_regex(std::string_view method, std::string_view target)
+{
+	std::cmatch match;
+
+	for(std::size_t i = 0; i < std::size(regex_routes); ++i)
+	{
+		const auto &[route_method, pattern] = regex_routes[i];
+
+		if(route_method == method && std::regex_match(target.data(), target.data() + target.size(), match, pattern))
+		{
+			return {static_cast<int>(i), match.size() > 1 ? std::string_view{match[1].first, static_cast<std::size_t>(match[1].length())} : std::string_view{}};
+		}
+	}
+
+	return {-1, {}};
+}
+
+static std::tuple<int, std::string_view> match_segments(std::string_view method, std::string_view target)
+{
+	const auto path = target.substr(0, target.find('?'));
+
+	std::string_view stream;
+
+	for(std::size_t i = 0; i < std::size(segment_routes); ++i)
+	{
+		const auto &[route_method, pattern] = segment_routes[i];
+
+		if(route_method == method && match_route(pattern, path, stream))
+		{
+			return {static_cast<int>(i), stream};
+		}
+	}
+
+	return {-1, {}};
+}
+
+template
+<
+	typename Router
+>
+static double time_router(Router router)
+{
+	auto matched = 0;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for(auto i = 0; i < rounds; ++i)
+	{
+		for(const auto &[method, target] : requests)
+		{
+			matched += std::get<0>(router(method, target)) >= 0;
+		}
+	}
+
+	const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+	// keeps the loop from being optimized away
+	if(matched < 0)
+	{
+		std::cout << matched;
+	}
+
+	return elapsed.count() / (rounds * std::size(requests));
+}
+
+// times routing the requests with the regex table against match_route, after checking both pick the same route and stream
+int main()
+{
+	for(const auto &[method, target] : requests)
+	{
+		if(match_regex(method, target) != match_segments(method, target))
+		{
+			std::cerr << method << ' ' << target << ": the routers disagree\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::cout << boost::format("%1$10s %2$14s\n") % "router" % "ns/request";
+	std::cout << boost::format("%1$10s %2$14.1f\n") % "regex" % time_router(match_regex);
+	std::cout << boost::format("%1$10s %2$14.1f\n") % "segments" % time_router(match_segments);
+
+	return EXIT_SUCCESS;
+}
@@ -1,238 +1,623 @@
 #include "catalog_generator.hpp"
 
-#include <queue>
-#include <unordered_set>
+#include <algorithm>
 
 #include <boost/format.hpp>
 
+constexpr std::string_view deleted_tag = "DELETED";
+
 catalog_generator::catalog_generator(kitman &kitman, int head)
-	: kitman_{kitman}, head_{head}, commits_{get_commits(head)}
+	: kitman_{kitman}, head_{head}
 {
 }
 
-std::vector<upgrade> catalog_generator::generate(const std::vector<std::string> &paths)
+void catalog_generator::extend(std::vector<upgrade> &upgrades, const std::vector<bool> &reachable, const std::vector<int> &commits)
 {
-	std::vector<upgrade> upgrades;
-
-	std::vector<int> replay_path;
-	std::vector<script> scripts;
+	std::vector<script_list> scripts;
 
-	for(const auto &p : paths)
+	for(auto &upgrade : upgrades)
 	{
-		const auto &upgrade_path = get_upgrade_path(p);
+		scripts.emplace_back(upgrade);
+	}
 
-		replay_path.clear();
-		scripts.clear();
+	load_files(commits);
 
-		auto path = get_direct_path(upgrade_path.commit_id);
-		const auto replay_from = path.size();
+	for(std::size_t i = 0; i < commits.size(); ++i)
+	{
+		const auto &[first, last] = file_ranges_[i];
 
-		path.insert(path.end(), upgrade_path.shortest_path.cbegin() + 1, upgrade_path.shortest_path.cend());
-		replay(replay_path, path, replay_from, path.size());
+		if(first == last)
+		{
+			continue;
+		}
 
-		auto &upgrade = upgrades.emplace_back(upgrade_path.from);
+		const auto tag = get_tag(commits[i]);
 
-		for(auto commit_id : replay_path)
+		// an upgrade from a commit the old head couldn't reach doesn't reach the new commits either
+		for(std::size_t j = 0; j < scripts.size(); ++j)
 		{
-			update_scripts(upgrade.scripts, commit_id);
+			if(reachable[j])
+			{
+				update_scripts(scripts[j], commits[i], file_ranges_[i], tag);
+			}
 		}
 	}
 
-	return upgrades;
+	for(std::size_t i = 0; i < upgrades.size(); ++i)
+	{
+		scripts[i].release(upgrades[i]);
+	}
+}
+
+int catalog_generator::find_index(int commit_id) const
+{
+	return commit_id > 0 && commit_id < static_cast<int>(indexes_.size()) ? indexes_[commit_id] : -1;
 }
 
-std::unordered_map<int, path_commit> catalog_generator::get_commits(int head)
+int catalog_generator::find_merge_point(int to_chain, int to_depth, int from_chain, int from_depth) const
 {
-	std::unordered_map<int, path_commit> commits;
+	const auto it = merge_points_.find({to_chain, from_chain});
 
-	for(const auto &commit : kitman_.get_commits(head))
+	if(it == merge_points_.cend())
 	{
-		commits.emplace(std::make_pair(commit.id, commit));
+		return -1;
+	}
+
+	const auto &points = it->second.points;
+
+	const auto last = std::lower_bound(points.cbegin(), points.cend(), std::make_tuple(to_depth, 0));
+
+	if(!it->second.ordered)
+	{
+		auto merge_point = -1;
+
+		for(auto point = points.cbegin(); point != last; ++point)
+		{
+			if(std::get<1>(*point) < from_depth)
+			{
+				merge_point = std::max(merge_point, std::get<1>(*point));
+			}
+		}
+
+		return merge_point;
 	}
 
-	return commits;
+	// merged depths grow along the target chain, so the last one below from_depth is the deepest
+	const auto point = std::lower_bound(points.cbegin(), last, from_depth, [](const std::tuple<int, int> &point, int depth)
+	{
+		return std::get<1>(point) < depth;
+	});
+
+	return point == points.cbegin() ? -1 : std::get<1>(*(point - 1));
 }
 
-std::vector<int> catalog_generator::get_direct_path(int to)
+std::vector<upgrade> catalog_generator::generate(const std::vector<std::string> &paths, std::vector<bool> &reachable)
 {
-	std::vector<int> path;
+	std::vector<upgrade> upgrades;
+
+	reachable.clear();
 
-	int commit_id = to;
+	load_commits();
+	load_files(ids_);
+
+	std::vector<int> replay_path;
+	std::unordered_map<int, std::size_t> replayed;
 
-	do
+	for(const auto &p : paths)
 	{
-		path.emplace_back(commit_id);
-		commit_id = commits_[commit_id].parent;
+		const auto &upgrade_path = get_upgrade_path(p);
+
+		// tags on the same commit get the same scripts
+		if(const auto it = replayed.find(upgrade_path.commit_id); it != replayed.cend())
+		{
+			auto upgrade = upgrades[it->second];
+			upgrade.from = upgrade_path.from;
+			upgrades.emplace_back(std::move(upgrade));
+			reachable.emplace_back(find_index(upgrade_path.commit_id) >= 0);
+			continue;
+		}
+
+		replayed.emplace(upgrade_path.commit_id, upgrades.size());
+
+		auto &upgrade = upgrades.emplace_back(upgrade_path.from);
+
+		reachable.emplace_back(find_index(upgrade_path.commit_id) >= 0);
+
+		// nothing leads from a commit the head can't reach
+		if(!reachable.back())
+		{
+			continue;
+		}
+
+		replay_path.clear();
+		++replay_epoch_;
+
+		chain_path path{get_index(upgrade_path.commit_id)};
+
+		for(auto it = upgrade_path.shortest_path.cbegin() + 1; it != upgrade_path.shortest_path.cend(); ++it)
+		{
+			path.rest.emplace_back(get_index(*it));
+		}
+
+		replay(replay_path, path, depths_[path.head] + 1, size(path));
+
+		script_list scripts;
+
+		for(auto index : replay_path)
+		{
+			update_scripts(scripts, index);
+		}
+
+		scripts.release(upgrade);
 	}
-	while(commit_id);
 
-	std::reverse(path.begin(), path.end());
+	return upgrades;
+}
+
+int catalog_generator::get_commit(const chain_path &path, std::size_t position) const
+{
+	const auto &chain = chains_[chain_ids_[path.head]];
+	const auto chain_size = static_cast<std::size_t>(depths_[path.head]) + 1;
 
-	return path;
+	return position < chain_size ? chain[position] : path.rest[position - chain_size];
 }
 
-const std::vector<file> &catalog_generator::get_files(int commit_id)
+int catalog_generator::get_index(int commit_id) const
 {
-	auto it = files_.find(commit_id);
+	const auto index = find_index(commit_id);
 
-	if(it == files_.cend())
+	if(index < 0)
 	{
-		it = files_.emplace(commit_id, kitman_.get_files(commit_id)).first;
+		throw exception{(boost::format("commit %1% is not reachable from head %2%") % commit_id % head_).str()};
 	}
 
-	return it->second;
+	return index;
 }
 
-const std::string &catalog_generator::get_last_tag(int commit_id)
+std::string_view catalog_generator::get_last_tag(int index)
 {
-	auto it = tags_.find(commit_id);
+	auto &tag = tags_[index];
 
-	if(it == tags_.cend())
+	if(tag.empty())
 	{
-		const auto &tag = kitman_.get_last_tag(commit_id);
-		it = tags_.emplace(commit_id, tag.empty() ? "DELETED" : tag).first;
+		tag = get_tag(ids_[index]);
 	}
 
-	return it->second;
+	return tag;
+}
+
+std::string_view catalog_generator::get_tag(int commit_id)
+{
+	const auto &tag = kitman_.get_last_tag(commit_id);
+
+	return tag.empty() ? deleted_tag : kitman_.intern(tag);
 }
 
 upgrade_path catalog_generator::get_upgrade_path(const std::string &path)
 {
 	upgrade_path upgrade_path{path, kitman_.get_commit(path)};
 
-	std::unordered_map<int, int> from_to;
-	std::unordered_set<int> visited;
-	std::queue<int> work;;
+	upgrade_path.shortest_path.emplace_back(upgrade_path.commit_id);
+
+	auto index = find_index(upgrade_path.commit_id);
+
+	if(index < 0 || child_offsets_[index] == child_offsets_[index + 1])
+	{
+		return upgrade_path;
+	}
 
-	work.emplace(head_);
+	// a search for this commit alone would stop as soon as it reached it, so later children don't count
+	const auto last_index = child_indexes_[child_offsets_[index]];
 
-	while(!work.empty())
+	for(;;)
 	{
-		const auto &commit = commits_[work.front()];
-		work.pop();
+		const auto first = child_indexes_.cbegin() + child_offsets_[index];
+		const auto last = child_indexes_.cbegin() + child_offsets_[index + 1];
+		const auto child = std::upper_bound(first, last, last_index);
 
-		if(!visited.emplace(commit.id).second)
+		if(child == first)
 		{
-			continue;
+			break;
 		}
 
-		if(commit.parent)
+		index = *(child - 1);
+		upgrade_path.shortest_path.emplace_back(ids_[index]);
+	}
+
+	return upgrade_path;
+}
+
+void catalog_generator::load_chains()
+{
+	const auto count = ids_.size();
+
+	std::vector<int> children(count, -1);
+
+	for(std::size_t i = 0; i < count; ++i)
+	{
+		if(const auto parent = parents_[i]; parent >= 0)
 		{
-			from_to[commit.parent] = commit.id;
-			work.emplace(commit.parent);
+			if(children[parent] >= 0)
+			{
+				throw exception{(boost::format("commit %1% is the parent of both %2% and %3%") % ids_[parent] % ids_[children[parent]] % ids_[i]).str()};
+			}
+
+			children[parent] = static_cast<int>(i);
 		}
+	}
+
+	chain_ids_.resize(count);
+	depths_.resize(count);
+	chains_.clear();
 
-		if(commit.merge_from)
+	for(std::size_t i = 0; i < count; ++i)
+	{
+		if(parents_[i] >= 0)
 		{
-			from_to[commit.merge_from] = commit.id;
-			work.emplace(commit.merge_from);
+			continue;
 		}
 
-		if(from_to.find(upgrade_path.commit_id) != from_to.cend())
+		const auto chain_id = static_cast<int>(chains_.size());
+		auto &chain = chains_.emplace_back();
+
+		for(auto index = static_cast<int>(i); index >= 0; index = children[index])
 		{
-			break;
+			chain_ids_[index] = chain_id;
+			depths_[index] = static_cast<int>(chain.size());
+			chain.emplace_back(index);
 		}
 	}
 
-	auto commit_id = upgrade_path.commit_id;
+	merge_points_.clear();
 
-	do
+	for(std::size_t i = 0; i < count; ++i)
 	{
-		upgrade_path.shortest_path.emplace_back(commit_id);
-		commit_id = from_to[commit_id];
+		if(const auto merge_from = merge_froms_[i]; merge_from >= 0)
+		{
+			merge_points_[{chain_ids_[i], chain_ids_[merge_from]}].points.emplace_back(depths_[i], depths_[merge_from]);
+		}
 	}
-	while(commit_id);
 
-	return upgrade_path;
+	for(auto &[chains, merge_points] : merge_points_)
+	{
+		auto &points = merge_points.points;
+
+		std::sort(points.begin(), points.end());
+
+		merge_points.ordered = std::is_sorted(points.cbegin(), points.cend(), [](const std::tuple<int, int> &x, const std::tuple<int, int> &y)
+		{
+			return std::get<1>(x) < std::get<1>(y);
+		});
+	}
 }
 
-void catalog_generator::merge(std::vector<int> &replay_path, const std::vector<int> &from_path, const std::vector<int> &to_path, std::size_t current_index)
+void catalog_generator::load_commits()
 {
-	for(int i = static_cast<int>(from_path.size()) - 2; i >= 0; --i)
+	const auto &commits = kitman_.get_commits(head_);
+
+	auto max_id = head_;
+
+	for(const auto &commit : commits)
+	{
+		max_id = std::max(max_id, commit.id);
+	}
+
+	std::vector<const path_commit *> commits_by_id(max_id + 1);
+
+	for(const auto &commit : commits)
 	{
-		const auto &from_commit = commits_[from_path[i]];
+		commits_by_id[commit.id] = &commit;
+	}
+
+	indexes_.assign(max_id + 1, -1);
+	ids_.clear();
 
-		for(int j = static_cast<int>(current_index) - 1; j >= 0; --j)
+	if(commits_by_id[head_])
+	{
+		indexes_[head_] = 0;
+		ids_.emplace_back(head_);
+	}
+
+	std::vector<int> child_counts(ids_.size());
+
+	for(std::size_t i = 0; i < ids_.size(); ++i)
+	{
+		const auto &commit = *commits_by_id[ids_[i]];
+
+		for(const auto next : {commit.parent, commit.merge_from})
 		{
-			const auto &to_commit = commits_[to_path[j]];
+			if(!next)
+			{
+				continue;
+			}
 
-			if(/* from_commit.merge_from == to_commit.id || */ to_commit.merge_from == from_commit.id)
+			if(indexes_[next] < 0)
 			{
-				replay(replay_path, from_path, i + 1, from_path.size());
-				return;
+				indexes_[next] = static_cast<int>(ids_.size());
+				ids_.emplace_back(next);
+				child_counts.emplace_back(0);
+			}
+
+			++child_counts[indexes_[next]];
+		}
+	}
+
+	const auto count = ids_.size();
+
+	parents_.resize(count);
+	merge_froms_.resize(count);
+	tags_.assign(count, {});
+	replay_epochs_.assign(count, 0);
+
+	child_offsets_.assign(count + 1, 0);
+
+	for(std::size_t i = 0; i < count; ++i)
+	{
+		const auto &commit = *commits_by_id[ids_[i]];
+
+		parents_[i] = commit.parent ? indexes_[commit.parent] : -1;
+		merge_froms_[i] = commit.merge_from ? indexes_[commit.merge_from] : -1;
+		child_offsets_[i + 1] = child_offsets_[i] + child_counts[i];
+	}
+
+	child_indexes_.resize(child_offsets_.back());
+
+	for(std::size_t i = 0; i < count; ++i)
+	{
+		for(const auto next : {parents_[i], merge_froms_[i]})
+		{
+			if(next >= 0)
+			{
+				child_indexes_[child_offsets_[next + 1] - child_counts[next]--] = static_cast<int>(i);
 			}
 		}
 	}
 
-	replay(replay_path, from_path, 1, from_path.size());
+	load_chains();
+}
+
+void catalog_generator::load_files(const std::vector<int> &commit_ids)
+{
+	std::vector<std::tuple<int, int>> positions;
+
+	for(std::size_t i = 0; i < commit_ids.size(); ++i)
+	{
+		positions.emplace_back(commit_ids[i], static_cast<int>(i));
+	}
+
+	std::sort(positions.begin(), positions.end());
+
+	std::vector<int> sorted_ids;
+
+	for(const auto &[commit_id, position] : positions)
+	{
+		sorted_ids.emplace_back(commit_id);
+	}
+
+	file_ranges_.assign(commit_ids.size(), {0, 0});
+	files_.clear();
+
+	// files come ordered by commit, so the matching position only ever moves forward
+	auto position = positions.cbegin();
+
+	kitman_.get_files(sorted_ids, [this, &position](int commit_id, std::string_view path, bool is_delete)
+	{
+		while(std::get<0>(*position) != commit_id)
+		{
+			++position;
+		}
+
+		auto &[first, last] = file_ranges_[std::get<1>(*position)];
+
+		if(first == last)
+		{
+			first = last = static_cast<int>(files_.size());
+		}
+
+		files_.emplace_back(path, is_delete);
+		++last;
+	});
+}
+
+void catalog_generator::merge(std::vector<int> &replay_path, int from, chain_path &to_path, std::size_t current_index)
+{
+	const auto from_chain = chain_ids_[from];
+	const auto from_depth = depths_[from];
+
+	// deepest commit of from's chain below it that to_path merged before current_index
+	const auto chain_size = static_cast<std::size_t>(depths_[to_path.head]) + 1;
+	auto merge_point = find_merge_point(chain_ids_[to_path.head], static_cast<int>(std::min(current_index, chain_size)), from_chain, from_depth);
+
+	for(; current_index > chain_size + to_path.merged; ++to_path.merged)
+	{
+		if(const auto merge_from = merge_froms_[to_path.rest[to_path.merged]]; merge_from >= 0)
+		{
+			to_path.merges[chain_ids_[merge_from]].emplace(depths_[merge_from]);
+		}
+	}
+
+	if(const auto it = to_path.merges.find(from_chain); it != to_path.merges.cend())
+	{
+		if(const auto depth = it->second.lower_bound(from_depth); depth != it->second.cbegin())
+		{
+			merge_point = std::max(merge_point, *std::prev(depth));
+		}
+	}
+
+	chain_path from_path{from};
+
+	replay(replay_path, from_path, merge_point >= 0 ? merge_point + 1 : 1, from_depth + 1);
 }
 
-void catalog_generator::replay(std::vector<int> &replay_path, const std::vector<int> &path, std::size_t from_index, std::size_t to_index)
+void catalog_generator::replay(std::vector<int> &replay_path, chain_path &path, std::size_t from_index, std::size_t to_index)
 {
 	for(auto current_index = from_index; current_index < to_index; ++current_index)
 	{
-		const auto &commit = commits_[path[current_index]];
+		const auto index = get_commit(path, current_index);
+		const auto merge_from = merge_froms_[index];
 
-		if(commit.merge_from)
+		if(merge_from >= 0)
 		{
-			if(current_index > 0 && commit.merge_from == path[current_index - 1])
+			if(current_index > 0 && merge_from == get_commit(path, current_index - 1))
 			{
-				auto merge_from_path = get_direct_path(commit.id);
-				merge(replay_path, merge_from_path, path, current_index);
+				merge(replay_path, index, path, current_index);
+
+				std::vector<int> rest;
 
-				from_index = merge_from_path.size();
-				merge_from_path.insert(merge_from_path.end(), path.cbegin() + current_index + 1, path.cend());
+				for(auto i = current_index + 1; i < size(path); ++i)
+				{
+					rest.emplace_back(get_commit(path, i));
+				}
 
-				replay(replay_path, merge_from_path, from_index, merge_from_path.size());
+				chain_path merge_from_path{index, std::move(rest)};
+
+				replay(replay_path, merge_from_path, depths_[index] + 1, size(merge_from_path));
 				return;
 			}
 
-			if(std::find(replay_path.cbegin(), replay_path.cend(), commit.merge_from) == replay_path.cend())
+			if(replay_epochs_[merge_from] != replay_epoch_)
 			{
-				const auto &merge_from_path = get_direct_path(commit.merge_from);
-				merge(replay_path, merge_from_path, path, current_index);
+				merge(replay_path, merge_from, path, current_index);
 			}
 		}
 
-		replay_path.emplace_back(commit.id);
+		replay_path.emplace_back(index);
+		replay_epochs_[index] = replay_epoch_;
+	}
+}
+
+std::size_t catalog_generator::size(const chain_path &path) const
+{
+	return depths_[path.head] + 1 + path.rest.size();
+}
+
+void catalog_generator::update_scripts(script_list &scripts, int index)
+{
+	const auto &[first, last] = file_ranges_[index];
+
+	if(first != last)
+	{
+		update_scripts(scripts, ids_[index], file_ranges_[index], get_last_tag(index));
+	}
+}
+
+void catalog_generator::update_scripts(script_list &scripts, int commit_id, const std::tuple<int, int> &file_range, std::string_view tag)
+{
+	const auto &[first, last] = file_range;
+
+	for(auto i = first; i < last; ++i)
+	{
+		const auto &[path, is_delete] = files_[i];
+
+		if(is_delete)
+		{
+			scripts.remove(path);
+		}
+		else
+		{
+			scripts.add(path, tag, commit_id);
+		}
+	}
+}
+
+catalog_generator::script_list::script_list(upgrade &upgrade)
+	: scripts_{std::move(upgrade.scripts)}, sources_{std::move(upgrade.sources)}, removed_(scripts_.size())
+{
+	for(std::size_t i = 0; i < scripts_.size(); ++i)
+	{
+		positions_.emplace(scripts_[i].path, i);
 	}
 }
 
-void catalog_generator::update_scripts(std::vector<script> &scripts, int commit_id)
+void catalog_generator::script_list::add(std::string_view path, std::string_view tag, int commit_id)
 {
-	const auto &files = get_files(commit_id);
+	const auto source = static_cast<int>(sources_.size());
+
+	sources_.emplace_back(tag, commit_id);
 
-	if(files.empty())
+	if(const auto it = positions_.find(path); it != positions_.cend())
 	{
+		auto &script = scripts_[it->second];
+
+		sources_[script.last_source].next = source;
+		script.last_source = source;
 		return;
 	}
 
-	const auto &tag = get_last_tag(commit_id);
+	positions_.emplace(path, scripts_.size());
+	scripts_.emplace_back(path, source);
+	removed_.emplace_back(false);
+}
 
-	for(const auto &file : files)
+void catalog_generator::script_list::compact()
+{
+	std::size_t count = 0;
+
+	for(std::size_t i = 0; i < scripts_.size(); ++i)
 	{
-		auto it = std::find_if(scripts.begin(), scripts.end(), [file](const script &script)
+		if(removed_[i])
 		{
-			return script.path == file.path;
-		});
+			continue;
+		}
 
-		if(!file.is_delete)
+		if(count != i)
 		{
-			if(it == scripts.end())
-			{
-				scripts.emplace_back(file.path, (boost::format("from %1% (ID %2%)") % tag % commit_id).str());
-			}
-			else
-			{
-				it->comment += (boost::format(", %1% (ID %2%)") % tag % commit_id).str();
-			}
+			scripts_[count] = std::move(scripts_[i]);
+			positions_[scripts_[count].path] = count;
 		}
-		else
+
+		++count;
+	}
+
+	scripts_.erase(scripts_.begin() + count, scripts_.end());
+	removed_.assign(count, false);
+}
+
+void catalog_generator::script_list::release(upgrade &upgrade)
+{
+	compact();
+
+	positions_.clear();
+	removed_.clear();
+
+	// drop the sources of removed scripts and store each script's entries next to each other
+	std::vector<script_source> sources;
+
+	for(auto &script : scripts_)
+	{
+		const auto first = static_cast<int>(sources.size());
+
+		for(auto source = script.first_source; source >= 0; source = sources_[source].next)
 		{
-			if(it != scripts.end())
+			if(static_cast<int>(sources.size()) > first)
 			{
-				scripts.erase(it);
+				sources.back().next = static_cast<int>(sources.size());
 			}
+
+			sources.emplace_back(sources_[source].tag, sources_[source].commit_id);
+		}
+
+		script.first_source = first;
+		script.last_source = static_cast<int>(sources.size()) - 1;
+	}
+
+	upgrade.scripts = std::move(scripts_);
+	upgrade.sources = std::move(sources);
+	sources_.clear();
+}
+
+void catalog_generator::script_list::remove(std::string_view path)
+{
+	const auto it = positions_.find(path);
+
+	if(it != positions_.cend())
+	{
+		removed_[it->second] = true;
+		positions_.erase(it);
+
+		if(2 * positions_.size() < scripts_.size())
+		{
+			compact();
 		}
 	}
 }
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <map>
+#include <set>
+#include <string_view>
+#include <tuple>
 #include <unordered_map>
 
 #include "kitman.hpp"
@@ -9,24 +13,99 @@ class catalog_generator
 public:
 	catalog_generator(kitman &kitman, int head);
 
-	std::vector<upgrade> generate(const std::vector<std::string> &paths);
+	void extend(std::vector<upgrade> &upgrades, const std::vector<bool> &reachable, const std::vector<int> &commits);
+	std::vector<upgrade> generate(const std::vector<std::string> &paths, std::vector<bool> &reachable);
 
 private:
+	// the parent chain from its root up to head, followed by rest; positions below the chain's length address the chain
+	struct chain_path
+	{
+		int head;
+		std::vector<int> rest;
+
+		// depths of the commits merged by rest[0] .. rest[merged - 1], per parent chain
+		std::map<int, std::set<int>> merges;
+		std::size_t merged = 0;
+
+		explicit chain_path(int head, std::vector<int> &&rest = {})
+			: head{head}, rest{std::move(rest)}
+		{
+		}
+	};
+
+	// merges from one parent chain into another as (depth in the target chain, depth of the merged commit in the source chain)
+	struct merge_points
+	{
+		std::vector<std::tuple<int, int>> points;
+		bool ordered;
+	};
+
+	// scripts of one upgrade in insertion order, removed ones stay behind as tombstones until compacted
+	class script_list
+	{
+	public:
+		script_list() = default;
+		explicit script_list(upgrade &upgrade);
+
+		void add(std::string_view path, std::string_view tag, int commit_id);
+		void remove(std::string_view path);
+
+		void release(upgrade &upgrade);
+
+	private:
+		std::vector<script> scripts_;
+		std::vector<script_source> sources_;
+		std::vector<bool> removed_;
+		std::unordered_map<std::string_view, std::size_t> positions_;
+
+		void compact();
+	};
+
 	kitman &kitman_;
 	int head_;
 
-	std::unordered_map<int, path_commit> commits_;
-	std::unordered_map<int, std::vector<file>> files_;
-	std::unordered_map<int, std::string> tags_;
+	// commits reachable from head_, indexed in the order a breadth-first search from head_ reaches them
+	std::vector<int> ids_;
+	std::vector<int> indexes_;
+	std::vector<int> parents_;
+	std::vector<int> merge_froms_;
+
+	// last tag of each commit, empty until looked up
+	std::vector<std::string_view> tags_;
+
+	// each commit's parent chain (one per stream) and its depth in it, chains_ lists every chain's commits by depth
+	std::vector<int> chain_ids_;
+	std::vector<int> depths_;
+	std::vector<std::vector<int>> chains_;
+	std::map<std::tuple<int, int>, merge_points> merge_points_;
+
+	// commits already in the current replay path carry the current epoch
+	std::vector<int> replay_epochs_;
+	int replay_epoch_ = 0;
+
+	// children of the commit at index i are child_indexes_[child_offsets_[i]] .. child_indexes_[child_offsets_[i + 1] - 1], in ascending order
+	std::vector<int> child_offsets_;
+	std::vector<int> child_indexes_;
+
+	// files loaded by load_files, those of commit_ids[i] are files_[first] .. files_[last - 1] for (first, last) = file_ranges_[i]
+	std::vector<std::tuple<int, int>> file_ranges_;
+	std::vector<std::tuple<std::string_view, bool>> files_;
 
-	std::unordered_map<int, path_commit> get_commits(int head);
-	std::vector<int> get_direct_path(int to);
+	int find_index(int commit_id) const;
+	int find_merge_point(int to_chain, int to_depth, int from_chain, int from_depth) const;
+	int get_commit(const chain_path &path, std::size_t position) const;
+	int get_index(int commit_id) const;
+	std::string_view get_tag(int commit_id);
 	upgrade_path get_upgrade_path(const std::string &path);
 
-	const std::vector<file> &get_files(int commit_id);
-	const std::string &get_last_tag(int commit_id);
+	std::string_view get_last_tag(int index);
 
-	void merge(std::vector<int> &replay_path, const std::vector<int> &from_path, const std::vector<int> &to_path, std::size_t current_index);
-	void replay(std::vector<int> &replay_path, const std::vector<int> &path, std::size_t from_index, std::size_t to_index);
-	void update_scripts(std::vector<script> &scripts, int commit_id);
+	void load_chains();
+	void load_commits();
+	void load_files(const std::vector<int> &commit_ids);
+	void merge(std::vector<int> &replay_path, int from, chain_path &to_path, std::size_t current_index);
+	void replay(std::vector<int> &replay_path, chain_path &path, std::size_t from_index, std::size_t to_index);
+	std::size_t size(const chain_path &path) const;
+	void update_scripts(script_list &scripts, int index);
+	void update_scripts(script_list &scripts, int commit_id, const std::tuple<int, int> &file_range, std::string_view tag);
 };
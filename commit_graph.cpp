@@ -0,0 +1,189 @@
+#include "commit_graph.hpp"
+
+#include "kitman.hpp"
+
+void commit_graph::add_commit(int id, int parent, int merge_from, int last_tag_id)
+{
+	if(id >= static_cast<int>(parents_.size()))
+	{
+		parents_.resize(id + 1);
+		merge_froms_.resize(id + 1);
+		depths_.resize(id + 1);
+		last_tags_.resize(id + 1);
+	}
+
+	parents_[id] = parent;
+	merge_froms_[id] = merge_from;
+	depths_[id] = parent ? depths_[parent] + 1 : 1;
+	last_tags_[id] = last_tag_id;
+}
+
+void commit_graph::add_tag(int id, const std::string &name, int commit_id)
+{
+	tags_.emplace(id, tag{name, commit_id});
+
+	if(contains(commit_id) && last_tags_[commit_id] < id)
+	{
+		last_tags_[commit_id] = id;
+	}
+}
+
+bool commit_graph::contains(int commit_id) const
+{
+	return commit_id > 0 && commit_id < static_cast<int>(parents_.size());
+}
+
+std::vector<path_commit> commit_graph::get_commits(int head) const
+{
+	std::vector<path_commit> commits;
+
+	if(!contains(head))
+	{
+		return commits;
+	}
+
+	std::vector<bool> visited(parents_.size());
+	std::vector<int> work{head};
+
+	visited[head] = true;
+
+	while(!work.empty())
+	{
+		const auto commit_id = work.back();
+		work.pop_back();
+
+		commits.emplace_back(commit_id, parents_[commit_id], merge_froms_[commit_id]);
+
+		for(const auto next : {parents_[commit_id], merge_froms_[commit_id]})
+		{
+			if(next && !visited[next])
+			{
+				visited[next] = true;
+				work.emplace_back(next);
+			}
+		}
+	}
+
+	return commits;
+}
+
+std::optional<std::vector<int>> commit_graph::get_commits_since(int ancestor, int head) const
+{
+	if(!contains(ancestor) || !contains(head) || depths_[head] < depths_[ancestor])
+	{
+		return {};
+	}
+
+	std::vector<int> commits(depths_[head] - depths_[ancestor]);
+
+	auto commit_id = head;
+
+	for(auto i = commits.size(); i > 0; --i)
+	{
+		if(merge_froms_[commit_id] || last_tags_[commit_id] != last_tags_[ancestor])
+		{
+			return {};
+		}
+
+		commits[i - 1] = commit_id;
+		commit_id = parents_[commit_id];
+	}
+
+	if(commit_id != ancestor)
+	{
+		return {};
+	}
+
+	return commits;
+}
+
+int commit_graph::get_depth(int commit_id) const
+{
+	return contains(commit_id) ? depths_[commit_id] : 0;
+}
+
+std::string commit_graph::get_last_tag(int commit_id) const
+{
+	if(!contains(commit_id) || !last_tags_[commit_id])
+	{
+		return {};
+	}
+
+	return tags_.at(last_tags_[commit_id]).name;
+}
+
+int commit_graph::get_last_tag_id(int commit_id) const
+{
+	return contains(commit_id) ? last_tags_[commit_id] : 0;
+}
+
+std::vector<std::string> commit_graph::get_paths(int head) const
+{
+	std::vector<std::string> paths;
+
+	const auto &reachable = get_reachable(head);
+
+	for(const auto &[id, tag] : tags_)
+	{
+		if(reachable[tag.commit_id])
+		{
+			paths.emplace_back(tag.name);
+		}
+	}
+
+	return paths;
+}
+
+std::vector<bool> commit_graph::get_reachable(int head) const
+{
+	std::vector<bool> reachable(parents_.size());
+
+	for(const auto &commit : get_commits(head))
+	{
+		reachable[commit.id] = true;
+	}
+
+	return reachable;
+}
+
+std::vector<bool> commit_graph::get_stream_commits(int head) const
+{
+	std::vector<bool> stream_commits(parents_.size());
+
+	for(auto commit_id = contains(head) ? head : 0; commit_id; commit_id = parents_[commit_id])
+	{
+		stream_commits[commit_id] = true;
+	}
+
+	return stream_commits;
+}
+
+std::vector<int> commit_graph::get_stream_tags(int head) const
+{
+	std::vector<int> stream_tags;
+
+	const auto &stream_commits = get_stream_commits(head);
+
+	for(const auto &[id, tag] : tags_)
+	{
+		if(stream_commits[tag.commit_id])
+		{
+			stream_tags.emplace_back(id);
+		}
+	}
+
+	return stream_tags;
+}
+
+void commit_graph::remove_stream_tags(int head)
+{
+	for(const auto id : get_stream_tags(head))
+	{
+		tags_.erase(id);
+	}
+
+	for(auto commit_id = contains(head) ? head : 0; commit_id; commit_id = parents_[commit_id])
+	{
+		last_tags_[commit_id] = 0;
+	}
+}
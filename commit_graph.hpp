@@ -0,0 +1,42 @@
+#pragma once
+
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct path_commit;
+
+class commit_graph
+{
+public:
+	void add_commit(int id, int parent, int merge_from, int last_tag_id);
+	void add_tag(int id, const std::string &name, int commit_id);
+
+	std::vector<path_commit> get_commits(int head) const;
+	std::optional<std::vector<int>> get_commits_since(int ancestor, int head) const;
+	int get_depth(int commit_id) const;
+	std::string get_last_tag(int commit_id) const;
+	int get_last_tag_id(int commit_id) const;
+	std::vector<std::string> get_paths(int head) const;
+	std::vector<int> get_stream_tags(int head) const;
+
+	void remove_stream_tags(int head);
+
+private:
+	struct tag
+	{
+		std::string name;
+		int commit_id;
+	};
+
+	std::vector<int> parents_;
+	std::vector<int> merge_froms_;
+	std::vector<int> depths_;
+	std::vector<int> last_tags_;
+	std::map<int, tag> tags_;
+
+	bool contains(int commit_id) const;
+	std::vector<bool> get_reachable(int head) const;
+	std::vector<bool> get_stream_commits(int head) const;
+};
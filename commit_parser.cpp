@@ -0,0 +1,254 @@
+#include "commit_parser.hpp"
+
+#include "kitman.hpp"
+
+commit_parser::~commit_parser() = default;
+
+const std::string &commit_parser::get_comment() const
+{
+	return comment_;
+}
+
+const std::string &commit_parser::get_error() const
+{
+	return error_;
+}
+
+const std::vector<file> &commit_parser::get_files() const
+{
+	return files_;
+}
+
+bool commit_parser::boolean(bool value)
+{
+	if(depth_ == 3 && in_files_ && field_ == field::is_delete)
+	{
+		std::get<2>(file_ranges_.back()) = value;
+		return true;
+	}
+
+	return scalar();
+}
+
+void commit_parser::clear()
+{
+	comment_.clear();
+	error_.clear();
+	paths_.clear();
+	file_ranges_.clear();
+	files_.clear();
+
+	// an idle keep-alive connection would otherwise hold on to the largest body it ever parsed
+	if(comment_.capacity() > retained_capacity)
+	{
+		comment_.shrink_to_fit();
+	}
+
+	if(paths_.capacity() > retained_capacity)
+	{
+		paths_.shrink_to_fit();
+	}
+
+	if(file_ranges_.capacity() * sizeof(file_ranges_[0]) > retained_capacity)
+	{
+		file_ranges_.shrink_to_fit();
+	}
+
+	if(files_.capacity() * sizeof(files_[0]) > retained_capacity)
+	{
+		files_.shrink_to_fit();
+	}
+
+	depth_ = 0;
+	field_ = field::none;
+	in_files_ = false;
+	has_comment_ = false;
+	has_files_ = false;
+	has_path_ = false;
+}
+
+bool commit_parser::end_array()
+{
+	if(depth_ == 2)
+	{
+		in_files_ = false;
+	}
+
+	--depth_;
+	field_ = field::none;
+
+	return true;
+}
+
+bool commit_parser::end_object()
+{
+	if(depth_ == 3 && in_files_ && !has_path_)
+	{
+		return fail("every file needs a path");
+	}
+
+	if(depth_ == 1 && (!has_comment_ || !has_files_))
+	{
+		return fail("comment and files are required");
+	}
+
+	--depth_;
+	field_ = field::none;
+
+	return true;
+}
+
+bool commit_parser::fail(const char *message)
+{
+	error_ = message;
+	return false;
+}
+
+bool commit_parser::key(string_t &name)
+{
+	if(depth_ == 1)
+	{
+		field_ = name == "comment" ? field::comment : name == "files" ? field::files : field::none;
+	}
+	else if(depth_ == 3 && in_files_)
+	{
+		field_ = name == "path" ? field::path : name == "delete" ? field::is_delete : field::none;
+	}
+	else
+	{
+		field_ = field::none;
+	}
+
+	return true;
+}
+
+bool commit_parser::null()
+{
+	return scalar();
+}
+
+bool commit_parser::number_float(number_float_t value, const string_t &text)
+{
+	return scalar();
+}
+
+bool commit_parser::number_integer(number_integer_t value)
+{
+	return scalar();
+}
+
+bool commit_parser::number_unsigned(number_unsigned_t value)
+{
+	return scalar();
+}
+
+bool commit_parser::parse(const std::string &body)
+{
+	clear();
+
+	if(!nlohmann::json::sax_parse(body, this))
+	{
+		return false;
+	}
+
+	for(const auto &[offset, length, is_delete] : file_ranges_)
+	{
+		files_.emplace_back(std::string_view{paths_}.substr(offset, length), is_delete);
+	}
+
+	return true;
+}
+
+bool commit_parser::parse_error(std::size_t position, const std::string &last_token, const nlohmann::detail::exception &e)
+{
+	return fail(e.what());
+}
+
+bool commit_parser::scalar()
+{
+	if(depth_ == 0)
+	{
+		return fail("the body must be an object");
+	}
+
+	if(depth_ == 2 && in_files_)
+	{
+		return fail("files must be objects");
+	}
+
+	switch(field_)
+	{
+	case field::comment:
+		return fail("comment must be a string");
+
+	case field::files:
+		return fail("files must be an array");
+
+	case field::path:
+		return fail("path must be a string");
+
+	case field::is_delete:
+		return fail("delete must be a boolean");
+
+	default:
+		return true;
+	}
+}
+
+bool commit_parser::start_array(std::size_t elements)
+{
+	if(depth_ == 1 && field_ == field::files)
+	{
+		in_files_ = true;
+		has_files_ = true;
+	}
+	else if(depth_ == 0 || field_ != field::none || (depth_ == 2 && in_files_))
+	{
+		return scalar();
+	}
+
+	++depth_;
+	field_ = field::none;
+
+	return true;
+}
+
+bool commit_parser::start_object(std::size_t elements)
+{
+	if(depth_ == 2 && in_files_)
+	{
+		file_ranges_.emplace_back(0, 0, false);
+		has_path_ = false;
+	}
+	else if(depth_ != 0 && field_ != field::none)
+	{
+		return scalar();
+	}
+
+	++depth_;
+	field_ = field::none;
+
+	return true;
+}
+
+bool commit_parser::string(string_t &value)
+{
+	if(depth_ == 1 && field_ == field::comment)
+	{
+		comment_ = std::move(value);
+		has_comment_ = true;
+		field_ = field::none;
+		return true;
+	}
+
+	if(depth_ == 3 && in_files_ && field_ == field::path)
+	{
+		file_ranges_.back() = {paths_.size(), value.size(), std::get<2>(file_ranges_.back())};
+		paths_ += value;
+		has_path_ = true;
+		field_ = field::none;
+		return true;
+	}
+
+	return scalar();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "json.hpp"
+
+struct file;
+
+// reads a commit_files body as it's parsed, paths are appended to one buffer that's reused by the next body
+class commit_parser : public nlohmann::json_sax<nlohmann::json>
+{
+public:
+	~commit_parser() override;
+
+	void clear();
+
+	const std::string &get_comment() const;
+	const std::string &get_error() const;
+	const std::vector<file> &get_files() const;
+
+	bool parse(const std::string &body);
+
+	bool null() override;
+	bool boolean(bool value) override;
+	bool number_integer(number_integer_t value) override;
+	bool number_unsigned(number_unsigned_t value) override;
+	bool number_float(number_float_t value, const string_t &text) override;
+	bool string(string_t &value) override;
+	bool start_object(std::size_t elements) override;
+	bool key(string_t &name) override;
+	bool end_object() override;
+	bool start_array(std::size_t elements) override;
+	bool end_array() override;
+	bool parse_error(std::size_t position, const std::string &last_token, const nlohmann::detail::exception &e) override;
+
+private:
+	// buffers that grew past this for one large body are given back by clear
+	static constexpr std::size_t retained_capacity = 64 * 1024;
+
+	enum class field
+	{
+		none, comment, files, path, is_delete
+	};
+
+	std::string comment_;
+	std::string error_;
+	std::string paths_;
+
+	// (offset in paths_, length, is_delete) of each file, turned into files_ once paths_ stops growing
+	std::vector<std::tuple<std::size_t, std::size_t, bool>> file_ranges_;
+	std::vector<file> files_;
+
+	// open arrays and objects, the field the next value at this depth is for, and what's been seen
+	int depth_ = 0;
+	field field_ = field::none;
+	bool in_files_ = false;
+	bool has_comment_ = false;
+	bool has_files_ = false;
+	bool has_path_ = false;
+
+	bool fail(const char *message);
+	bool scalar();
+};
@@ -1,14 +1,44 @@
 #include "db.hpp"
 
-database::database(const char *db_path)
+std::ostream &operator<<(std::ostream &stream, const database_settings &settings)
 {
-	if(sqlite3_open(db_path, &db_))
+	return stream
+		<< "journal_mode=" << settings.journal_mode
+		<< ", synchronous=" << settings.synchronous
+		<< ", cache_size=" << settings.cache_size
+		<< ", reader_cache_size=" << settings.reader_cache_size
+		<< ", mmap_size=" << settings.mmap_size
+		<< ", temp_store=" << settings.temp_store;
+}
+
+database::database(const char *db_path, const database_settings &settings, int flags)
+{
+	if(sqlite3_open_v2(db_path, &db_, flags, nullptr))
 	{
 		std::string error = sqlite3_errmsg(db_);
 		sqlite3_close(db_);
 		throw exception{error};
 	}
 
+	try
+	{
+		// journal mode is persistent and can only be switched by a writer
+		if(flags & SQLITE_OPEN_READWRITE)
+		{
+			pragma("journal_mode", settings.journal_mode);
+		}
+
+		pragma("synchronous", settings.synchronous);
+		pragma("cache_size", std::to_string(flags & SQLITE_OPEN_READWRITE ? settings.cache_size : settings.reader_cache_size));
+		pragma("mmap_size", std::to_string(settings.mmap_size));
+		pragma("temp_store", settings.temp_store);
+	}
+	catch(...)
+	{
+		sqlite3_close(db_);
+		throw;
+	}
+
 	begin_transaction_.prepare(db_, "BEGIN TRANSACTION");
 	commit_transaction_.prepare(db_, "COMMIT TRANSACTION");
 	rollback_transaction_.prepare(db_, "ROLLBACK TRANSACTION");
@@ -24,9 +54,50 @@ int database::get_last_id() const
 	return sqlite3_last_insert_rowid(db_);
 }
 
+void database::reset_statements()
+{
+	for(auto stmt = sqlite3_next_stmt(db_, nullptr); stmt; stmt = sqlite3_next_stmt(db_, stmt))
+	{
+		sqlite3_reset(stmt);
+	}
+}
+
+database_settings database::get_settings()
+{
+	static const char *const synchronous_modes[]{"OFF", "NORMAL", "FULL", "EXTRA"};
+	static const char *const temp_stores[]{"DEFAULT", "FILE", "MEMORY"};
+
+	database_settings settings;
+
+	settings.journal_mode = pragma("journal_mode");
+	settings.synchronous = synchronous_modes[std::stoi(pragma("synchronous")) & 3];
+	settings.cache_size = std::stoi(pragma("cache_size"));
+	settings.mmap_size = std::stoll(pragma("mmap_size"));
+	settings.temp_store = temp_stores[std::stoi(pragma("temp_store")) % 3];
+
+	return settings;
+}
+
+std::string database::pragma(const std::string &name, const std::string &value)
+{
+	statement stmt;
+
+	stmt.prepare(db_, ("PRAGMA " + name + (value.empty() ? "" : " = " + value)).data());
+
+	if(!stmt.step())
+	{
+		return {};
+	}
+
+	const auto result = stmt.get_text(0);
+
+	return result ? result : "";
+}
+
 database::~database()
 {
-	sqlite3_close(db_);
+	// the transaction statements are members and get finalized only after this, so the connection closes with the last of them
+	sqlite3_close_v2(db_);
 }
 
 void statement::bind_value(int index, int value)
@@ -39,7 +110,7 @@ void statement::bind_value(int index, const char *value)
 	check(sqlite3_bind_text(stmt_, index, value, -1, nullptr));
 }
 
-void statement::bind_value(int index, const std::string &value)
+void statement::bind_value(int index, std::string_view value)
 {
 	check(sqlite3_bind_text(stmt_, index, value.data(), value.size(), nullptr));
 }
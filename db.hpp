@@ -1,12 +1,28 @@
 #pragma once
 
 #include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
 
 #include "exception.hpp"
 #include "sqlite3.h"
 
 class database;
 
+struct database_settings
+{
+	std::string journal_mode = "WAL";
+	std::string synchronous = "NORMAL";
+	// cache sizes are per connection, cache_size for the writer and reader_cache_size for each read-only connection
+	int cache_size = -65536;
+	int reader_cache_size = -4096;
+	long long mmap_size = 268435456;
+	std::string temp_store = "MEMORY";
+};
+
+std::ostream &operator<<(std::ostream &stream, const database_settings &settings);
+
 class statement
 {
 public:
@@ -25,6 +41,37 @@ public:
 		bind_values(1, value, values...);
 	}
 
+	// binds values to the parameters from index on without resetting the statement or touching other parameters
+	template
+	<
+		typename ...Values
+	>
+	void bind_at(int index, Values &&...values)
+	{
+		bind_values(index, values...);
+	}
+
+	template
+	<
+		typename Iterator
+	>
+	void bind_range(Iterator first, Iterator last)
+	{
+		reset();
+
+		auto index = 1;
+
+		for(; first != last; ++first)
+		{
+			bind_value(index++, *first);
+		}
+
+		for(const auto count = sqlite3_bind_parameter_count(stmt_); index <= count; ++index)
+		{
+			check(sqlite3_bind_null(stmt_, index));
+		}
+	}
+
 	template
 	<
 		typename ...Values
@@ -57,7 +104,7 @@ private:
 
 	void bind_value(int index, int value);
 	void bind_value(int index, const char *value);
-	void bind_value(int index, const std::string &value);
+	void bind_value(int index, std::string_view value);
 
 	template
 	<
@@ -105,7 +152,7 @@ private:
 class database
 {
 public:
-	explicit database(const char *db_path);
+	database(const char *db_path, const database_settings &settings, int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
 
 	database(const database &) = delete;
 	database &operator=(const database &) = delete;
@@ -113,6 +160,10 @@ public:
 	operator sqlite3 *();
 
 	int get_last_id() const;
+	database_settings get_settings();
+
+	// ends the read transaction a pending statement would otherwise keep open
+	void reset_statements();
 
 	~database();
 
@@ -124,4 +175,6 @@ private:
 	statement begin_transaction_;
 	statement commit_transaction_;
 	statement rollback_transaction_;
+
+	std::string pragma(const std::string &name, const std::string &value = "");
 };
@@ -4,8 +4,8 @@
 namespace asio = boost::asio;
 namespace beast = boost::beast;
 
-http_listener::http_listener(asio::io_context &io, unsigned short port, const std::string &web_root, kitman &kitman)
-	: io_{io}, acceptor_{io_}, web_root_{web_root}, kitman_{kitman}
+http_listener::http_listener(asio::io_context &io, asio::thread_pool &db_pool, unsigned short port, std::uint64_t max_body_size, const std::string &web_root, kitman &kitman)
+	: io_{io}, db_pool_{db_pool}, acceptor_{io_}, max_body_size_{max_body_size}, web_root_{web_root}, kitman_{kitman}
 {
 	asio::ip::tcp::endpoint endpoint{asio::ip::make_address("0.0.0.0"), port};
 
@@ -17,7 +17,7 @@ http_listener::http_listener(asio::io_context &io, unsigned short port, const st
 
 void http_listener::accept()
 {
-	acceptor_.async_accept(io_, beast::bind_front_handler(&http_listener::on_accept, this));
+	acceptor_.async_accept(asio::make_strand(io_), beast::bind_front_handler(&http_listener::on_accept, this));
 }
 
 void http_listener::on_accept(const std::error_code &ec, boost::asio::ip::tcp::socket socket)
@@ -27,7 +27,7 @@ void http_listener::on_accept(const std::error_code &ec, boost::asio::ip::tcp::s
 		return;
 	}
 
-	std::make_shared<http_session>(std::move(socket), web_root_, kitman_)->run();
+	std::make_shared<http_session>(std::move(socket), db_pool_.get_executor(), max_body_size_, web_root_, kitman_)->run();
 
 	accept();
 }
@@ -1,19 +1,22 @@
 #pragma once
 
 #include <boost/asio.hpp>
+#include <boost/asio/thread_pool.hpp>
 
 class kitman;
 
 class http_listener
 {
 public:
-	http_listener(boost::asio::io_context &io, unsigned short port, const std::string &web_root, kitman &kitman);
+	http_listener(boost::asio::io_context &io, boost::asio::thread_pool &db_pool, unsigned short port, std::uint64_t max_body_size, const std::string &web_root, kitman &kitman);
 
 	void run();
 
 private:
 	boost::asio::io_context &io_;
+	boost::asio::thread_pool &db_pool_;
 	boost::asio::ip::tcp::acceptor acceptor_;
+	std::uint64_t max_body_size_;
 	std::string web_root_;
 	kitman &kitman_;
 
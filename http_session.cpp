@@ -1,11 +1,15 @@
 #include "http_session.hpp"
 
-#include <boost/algorithm/string/classification.hpp>
-#include <boost/algorithm/string/split.hpp>
-#include <boost/lexical_cast.hpp>
+#include <charconv>
 
+#include <boost/asio/post.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/format.hpp>
+
+#include "json_writer.hpp"
 #include "kitman.hpp"
 #include "mime.hpp"
+#include "route.hpp"
 #include "static.hpp"
 #include "utils.hpp"
 
@@ -17,42 +21,19 @@ using json = nlohmann::json;
 
 const http_session::route http_session::routes_[]
 {
-	{&http_session::commit_files, http::verb::post, std::regex{"/streams/([^/]+)/commits"}},
-	{&http_session::create_stream, http::verb::post, std::regex{"/streams"}},
-	{&http_session::create_tag, http::verb::post, std::regex{"/streams/([^/]+)/tags"}},
-	{&http_session::delete_stream, http::verb::delete_, std::regex{"/streams/([^/]+)"}},
-	{&http_session::get_catalog, http::verb::get, std::regex{"/streams/([^/]+)/catalog(\\?.*)?"}},
-	{&http_session::get_commits, http::verb::get, std::regex{"/streams/([^/]+)/commits(\\?.*)?"}},
-	{&http_session::get_paths, http::verb::get, std::regex{"/streams/([^/]+)/paths"}},
-	{&http_session::get_streams, http::verb::get, std::regex{"/streams"}},
-	{&http_session::merge, http::verb::post, std::regex{"/streams/([^/]+)/merge"}}
+	{&http_session::commit_files, http::verb::post, "/streams/{stream}/commits"},
+	{&http_session::create_stream, http::verb::post, "/streams"},
+	{&http_session::create_tag, http::verb::post, "/streams/{stream}/tags"},
+	{&http_session::delete_stream, http::verb::delete_, "/streams/{stream}"},
+	{&http_session::get_catalog, http::verb::get, "/streams/{stream}/catalog"},
+	{&http_session::get_commits, http::verb::get, "/streams/{stream}/commits"},
+	{&http_session::get_paths, http::verb::get, "/streams/{stream}/paths"},
+	{&http_session::get_streams, http::verb::get, "/streams"},
+	{&http_session::merge, http::verb::post, "/streams/{stream}/merge"}
 };
 
-template
-<
-	typename T
->
-T get_query_param(const std::map<std::string, std::string> &params, const std::string &name, T default_value)
-{
-	const auto &it = params.find(name);
-
-	if(it == params.cend())
-	{
-		return default_value;
-	}
-
-	T value;
-
-	if(boost::conversion::try_lexical_convert(it->second, value))
-	{
-		return value;
-	}
-
-	return default_value;
-}
-
-http_session::http_session(asio::ip::tcp::socket &&socket, const std::string &web_root, kitman &kitman)
-	: stream_{std::move(socket)}, web_root_{web_root}, kitman_{kitman}
+http_session::http_session(asio::ip::tcp::socket &&socket, asio::thread_pool::executor_type db_executor, std::uint64_t max_body_size, const std::string &web_root, kitman &kitman)
+	: stream_{std::move(socket)}, db_executor_{db_executor}, web_root_{web_root}, kitman_{kitman}, max_body_size_{max_body_size}
 {
 }
 
@@ -62,25 +43,26 @@ void http_session::close()
 	stream_.socket().shutdown(asio::ip::tcp::socket::shutdown_send, ec);
 }
 
-void http_session::commit_files(const std::cmatch &params, const nlohmann::json &body)
+void http_session::commit_files(const route_params &params)
 {
-	const auto &stream = params[1];
-	const auto &comment = body.at("comment").get<std::string>();
-
-	std::vector<file> files;
+	const std::string stream{params.stream};
 
-	for(const auto &file_json : body.at("files"))
+	if(!commit_parser_.parse(request_.body()))
 	{
-		files.emplace_back(file_json.at("path").get<std::string>(), file_json.value("delete", false));
+		send(http::status::bad_request, std::string{commit_parser_.get_error()});
+		commit_parser_.clear();
+		return;
 	}
 
-	kitman_.commit_files(stream, comment, files);
+	kitman_.commit_files(stream, commit_parser_.get_comment(), commit_parser_.get_files());
+	commit_parser_.clear();
 
 	send(http::status::created);
 }
 
-void http_session::create_stream(const std::cmatch &params, const nlohmann::json &body)
+void http_session::create_stream(const route_params &params)
 {
+	const auto &body = parse_body();
 	const auto &name = body.at("name").get<std::string>();
 	const auto &parent = body.value("parent", "");
 	const auto &tag = body.at("tag").get<std::string>();
@@ -90,9 +72,10 @@ void http_session::create_stream(const std::cmatch &params, const nlohmann::json
 	send(http::status::created);
 }
 
-void http_session::create_tag(const std::cmatch &params, const nlohmann::json &body)
+void http_session::create_tag(const route_params &params)
 {
-	const auto &stream = params[1];
+	const std::string stream{params.stream};
+	const auto &body = parse_body();
 	const auto &tag = body.at("name").get<std::string>();
 
 	kitman_.create_tag(stream, tag);
@@ -100,127 +83,175 @@ void http_session::create_tag(const std::cmatch &params, const nlohmann::json &b
 	send(http::status::created);
 }
 
-void http_session::delete_stream(const std::cmatch &params, const nlohmann::json &body)
+void http_session::delete_stream(const route_params &params)
 {
-	kitman_.delete_stream(params[1]);
+	kitman_.delete_stream(std::string{params.stream});
 	send(http::status::ok);
 }
 
-void http_session::get_catalog(const std::cmatch &params, const nlohmann::json &body)
+void http_session::get_catalog(const route_params &params)
 {
-	const auto &stream = params[1];
-	const auto &query_params = parse_query_string(params[2]);
-	const auto &paths_param = get_query_param<std::string>(query_params, "paths", "");
+	const std::string stream{params.stream};
+	const query_params query{params.query_string};
 
 	std::vector<std::string> paths;
 
-	if(!paths_param.empty())
+	// paths can be repeated as well as comma separated
+	for(auto paths_param : query.get_all("paths"))
 	{
-		boost::split(paths, paths_param, boost::is_any_of(","));
-	}
-
-	const auto &upgrades = kitman_.get_catalog(stream, paths);
+		if(paths_param.empty())
+		{
+			continue;
+		}
 
-	std::stringstream ss;
+		for(;;)
+		{
+			const auto comma = paths_param.find(',');
 
-	ss << upgrades;
+			paths.emplace_back(paths_param.substr(0, comma));
 
-	http::response<http::string_body> response{http::status::ok, request_.version()};
+			if(comma == std::string_view::npos)
+			{
+				break;
+			}
 
-	response.keep_alive(request_.keep_alive());
-	response.set(http::field::content_disposition, "attachment; filename=\"catalogue.xml\"");
-	response.set(http::field::content_type, "text/xml");
-	response.body() = ss.str();
-	response.prepare_payload();
+			paths_param.remove_prefix(comma + 1);
+		}
+	}
 
-	send(std::move(response));
+	send_catalog(kitman_.get_catalog(stream, paths));
 }
 
-void http_session::get_commits(const std::cmatch &params, const nlohmann::json &body)
+void http_session::get_commits(const route_params &params)
 {
-	const auto &stream = params[1];
-	const auto &query_params = parse_query_string(params[2]);
-	const auto &sort = get_query_param<std::string>(query_params, "sort", "id");
-	const auto &order = get_query_param<std::string>(query_params, "order", "desc");
-	const auto page = get_query_param(query_params, "page", 0);
-	const auto page_size = get_query_param(query_params, "pageSize", std::numeric_limits<int>::max());
+	const std::string stream{params.stream};
+	const query_params query{params.query_string};
+	const std::string sort{query.get("sort", "id")};
+	const std::string order{query.get("order", "desc")};
+	const auto page = query.get("page", 0);
+	const auto page_size = query.get("pageSize", std::numeric_limits<int>::max());
+	const auto after = query.get("after", 0);
 
-	const auto &[total, commits] = kitman_.get_commits(stream, sort, order, page, page_size);
+	const auto &[total, commits] = after
+		? kitman_.get_commits_after(stream, sort, order, after, page_size)
+		: kitman_.get_commits(stream, sort, order, page, page_size);
 
-	auto response = json::object();
+	// keys are written in alphabetical order, as nlohmann::json used to sort them
+	json_writer json{query.get("pretty", 0) != 0};
 
-	response["total"] = total;
-	auto &commits_json = response["commits"] = json::array();
+	json.begin_object();
+	json.key("commits");
+	json.begin_array();
 
 	for(const auto &commit : commits)
 	{
-		auto &commit_json = commits_json.emplace_back(json::object());
+		json.begin_object();
+		json.key("comment");
+		json.string(commit.comment);
+		json.key("date");
+		json.string(commit.date);
+		json.key("files");
+		json.begin_array();
 
-		commit_json["id"] = commit.id;
-		commit_json["comment"] = commit.comment;
-		commit_json["date"] = commit.date;
+		for(const auto &file : commit.files)
+		{
+			json.begin_object();
+			json.key("delete");
+			json.boolean(file.is_delete);
+			json.key("path");
+			json.string(file.path);
+			json.end_object();
+		}
 
-		auto &tags_json = commit_json["tags"] = json::array();
+		json.end_array();
+		json.key("id");
+		json.number(commit.id);
+		json.key("mergeFromTag");
+		json.string(commit.merge_from_tag);
+		json.key("tags");
+		json.begin_array();
 
 		for(const auto &tag : commit.tags)
 		{
-			tags_json.emplace_back(tag);
+			json.string(tag);
 		}
 
-		commit_json["mergeFromTag"] = commit.merge_from_tag;
-
-		auto &files_json = commit_json["files"] = json::array();
+		json.end_array();
+		json.end_object();
+	}
 
-		for(const auto &file : commit.files)
-		{
-			auto &file_json = files_json.emplace_back(json::object());
+	json.end_array();
+	json.key("next");
 
-			file_json["path"] = file.path;
-			file_json["delete"] = file.is_delete;
-		}
+	if(!commits.empty() && static_cast<int>(commits.size()) == page_size)
+	{
+		json.number(commits.back().id);
+	}
+	else
+	{
+		json.null();
 	}
 
-	send_json(response);
+	json.key("total");
+	json.number(total);
+	json.end_object();
+
+	send_json(json);
 }
 
-void http_session::get_paths(const std::cmatch &params, const nlohmann::json &body)
+void http_session::get_paths(const route_params &params)
 {
-	const auto &stream = params[1];
+	const std::string stream{params.stream};
+	const query_params query{params.query_string};
 	const auto &paths = kitman_.get_paths(stream);
 
-	auto response = json::array();
+	json_writer json{query.get("pretty", 0) != 0};
+
+	json.begin_array();
 
 	for(const auto &path : paths)
 	{
-		response.emplace_back(path);
+		json.string(path);
 	}
 
-	send_json(response);
+	json.end_array();
+
+	send_json(json);
 }
 
-void http_session::get_streams(const std::cmatch &params, const nlohmann::json &body)
+void http_session::get_streams(const route_params &params)
 {
+	const query_params query{params.query_string};
 	const auto &streams = kitman_.get_streams();
 
-	auto response = json::array();
+	json_writer json{query.get("pretty", 0) != 0};
+
+	json.begin_array();
 
 	for(const auto &stream : streams)
 	{
-		auto &stream_json = response.emplace_back(json::object());
-
-		stream_json["name"] = stream.name;
-		stream_json["tag"] = stream.tag;
-		stream_json["parent"] = stream.parent;
-
-		auto &children_json = stream_json["children"] = json::array();
+		json.begin_object();
+		json.key("children");
+		json.begin_array();
 
 		for(const auto &child : stream.children)
 		{
-			children_json.emplace_back(child);
+			json.string(child);
 		}
+
+		json.end_array();
+		json.key("name");
+		json.string(stream.name);
+		json.key("parent");
+		json.string(stream.parent);
+		json.key("tag");
+		json.string(stream.tag);
+		json.end_object();
 	}
 
-	send_json(response);
+	json.end_array();
+
+	send_json(json);
 }
 
 bool http_session::handle_request()
@@ -241,9 +272,18 @@ bool http_session::handle_request()
 bool http_session::handle_rest()
 {
 	const auto &url = request_.target();
+	const auto target = std::string_view{url.data(), url.size()};
+	const auto query_start = target.find('?');
+	const auto path = target.substr(0, query_start);
+
+	route_params params;
 
-	std::cmatch params;
+	if(query_start != std::string_view::npos)
+	{
+		params.query_string = target.substr(query_start + 1);
+	}
 
+	// routes match the path alone, handlers that take no parameters ignore the query string
 	for(const auto &[handler, method, pattern] : routes_)
 	{
 		if(request_.method() != method)
@@ -251,30 +291,12 @@ bool http_session::handle_rest()
 			continue;
 		}
 
-		if(!std::regex_match(url.cbegin(), url.cend(), params, pattern))
+		if(!match_route(pattern, path, params.stream))
 		{
 			continue;
 		}
 
-		try
-		{
-			json body;
-
-			if(request_.method() == http::verb::post && !request_.body().empty())
-			{
-				body = json::parse(request_.body());
-			}
-
-			(this->*handler)(params, body);
-		}
-		catch(const json::exception &e)
-		{
-			send(http::status::bad_request, e.what());
-		}
-		catch(const std::exception &e)
-		{
-			send(http::status::internal_server_error, e.what());
-		}
+		asio::post(db_executor_, beast::bind_front_handler(&http_session::run_handler, shared_from_this(), handler, params));
 
 		return true;
 	}
@@ -356,9 +378,10 @@ bool http_session::handle_web_root()
 	return true;
 }
 
-void http_session::merge(const std::cmatch &params, const nlohmann::json &body)
+void http_session::merge(const route_params &params)
 {
-	const auto &stream = params[1];
+	const std::string stream{params.stream};
+	const auto &body = parse_body();
 	const auto &from = body.at("from").get<std::string>();
 
 	kitman_.merge(from, stream);
@@ -368,6 +391,15 @@ void http_session::merge(const std::cmatch &params, const nlohmann::json &body)
 
 void http_session::on_read(const boost::beast::error_code &ec, std::size_t)
 {
+	if(ec == http::error::body_limit)
+	{
+		request_ = parser_->release();
+		request_.keep_alive(false);
+
+		send(http::status::payload_too_large, (boost::format("request body is larger than %1% bytes") % max_body_size_).str());
+		return;
+	}
+
 	if(ec)
 	{
 		if(ec == http::error::end_of_stream)
@@ -378,6 +410,8 @@ void http_session::on_read(const boost::beast::error_code &ec, std::size_t)
 		return;
 	}
 
+	request_ = parser_->release();
+
 	if(!handle_request())
 	{
 		send(http::status::not_found);
@@ -386,7 +420,7 @@ void http_session::on_read(const boost::beast::error_code &ec, std::size_t)
 
 void http_session::on_write(bool close, const beast::error_code &ec, std::size_t)
 {
-	if(ec)
+	if(ec || close)
 	{
 		if(close)
 		{
@@ -401,58 +435,19 @@ void http_session::on_write(bool close, const beast::error_code &ec, std::size_t
 	read();
 }
 
-std::map<std::string, std::string> http_session::parse_query_string(const std::string &query_string)
+nlohmann::json http_session::parse_body() const
 {
-	std::map<std::string, std::string> params;
-
-	std::string key;
-	std::string value;
-
-	auto in_key = true;
-
-	for(auto i = 1u; i < query_string.size(); ++i)
-	{
-		auto c = query_string[i];
-
-		switch(c)
-		{
-		case '&':
-			params.emplace(std::make_pair(key, value));
-			key.clear();
-			value.clear();
-			in_key = true;
-			break;
-
-		case '=':
-			in_key = false;
-			break;
-
-		default:
-			if(in_key)
-			{
-				key += c;
-			}
-			else
-			{
-				value += c;
-			}
-
-			break;
-		}
-	}
-
-	if(!key.empty())
-	{
-		params.emplace(std::make_pair(key, value));
-	}
-
-	return params;
+	return request_.body().empty() ? json{} : json::parse(request_.body());
 }
 
 void http_session::read()
 {
 	request_ = {};
-	http::async_read(stream_, buffer_, request_, beast::bind_front_handler(&http_session::on_read, shared_from_this()));
+
+	parser_.emplace();
+	parser_->body_limit(max_body_size_);
+
+	http::async_read(stream_, buffer_, *parser_, beast::bind_front_handler(&http_session::on_read, shared_from_this()));
 }
 
 void http_session::run()
@@ -460,13 +455,29 @@ void http_session::run()
 	read();
 }
 
-void http_session::send(http::status status, const std::string &body, const char *content_type)
+void http_session::run_handler(handler handler, const route_params &params)
+{
+	try
+	{
+		(this->*handler)(params);
+	}
+	catch(const json::exception &e)
+	{
+		send(http::status::bad_request, e.what());
+	}
+	catch(const std::exception &e)
+	{
+		send(http::status::internal_server_error, e.what());
+	}
+}
+
+void http_session::send(http::status status, std::string &&body, const char *content_type)
 {
 	http::response<http::string_body> response{status, request_.version()};
 
 	response.keep_alive(request_.keep_alive());
 	response.set(http::field::content_type, content_type ? content_type : "text/plain");
-	response.body() = body;
+	response.body() = std::move(body);
 	response.prepare_payload();
 
 	send(std::move(response));
@@ -486,7 +497,203 @@ void http_session::send(http::status status, http::file_body::value_type &&body,
 	send(std::move(response));
 }
 
-void http_session::send_json(const nlohmann::json &response)
+void http_session::send_catalog(std::shared_ptr<const std::vector<upgrade>> upgrades)
+{
+	// HTTP/1.0 clients don't know chunked encoding, they get the whole catalog with a Content-Length
+	if(request_.version() < 11)
+	{
+		std::string xml;
+
+		write_catalog_begin(xml);
+
+		for(std::size_t i = 0; i < upgrades->size(); ++i)
+		{
+			write_upgrade(xml, (*upgrades)[i], i == 0);
+		}
+
+		write_catalog_end(xml);
+
+		http::response<http::string_body> response{http::status::ok, request_.version()};
+
+		response.keep_alive(request_.keep_alive());
+		response.set(http::field::content_disposition, "attachment; filename=\"catalogue.xml\"");
+		response.set(http::field::content_type, "text/xml");
+		response.body() = std::move(xml);
+		response.prepare_payload();
+
+		send(std::move(response));
+		return;
+	}
+
+	auto catalog = std::make_shared<catalog_response>();
+	auto &response = catalog->response;
+
+	response.result(http::status::ok);
+	response.version(request_.version());
+	response.keep_alive(request_.keep_alive());
+	response.set(http::field::content_disposition, "attachment; filename=\"catalogue.xml\"");
+	response.set(http::field::content_type, "text/xml");
+	response.chunked(true);
+
+	catalog->upgrades = std::move(upgrades);
+
+	asio::dispatch(stream_.get_executor(), [self = shared_from_this(), catalog]
+	{
+		self->response_ = catalog;
+		http::async_write_header(self->stream_, catalog->serializer, beast::bind_front_handler(&http_session::write_catalog, self, catalog));
+	});
+}
+
+void http_session::send_json(json_writer &json)
+{
+	send(http::status::ok, json.release(), "application/json");
+}
+
+void http_session::write_catalog(std::shared_ptr<catalog_response> catalog, const beast::error_code &ec, std::size_t)
+{
+	const auto close = catalog->response.need_eof();
+
+	if(ec)
+	{
+		on_write(close, ec, 0);
+		return;
+	}
+
+	if(catalog->finished)
+	{
+		asio::async_write(stream_, http::make_chunk_last(), beast::bind_front_handler(&http_session::on_write, shared_from_this(), close));
+		return;
+	}
+
+	// at most one chunk is formatted at a time, a large upgrade is split between chunks at script boundaries
+	const auto &upgrades = *catalog->upgrades;
+	auto &xml = catalog->xml;
+
+	xml.clear();
+
+	if(catalog->next == 0 && catalog->next_script == 0)
+	{
+		write_catalog_begin(xml);
+	}
+
+	while(catalog->next < upgrades.size() && xml.size() < catalog_chunk_size)
+	{
+		const auto &upgrade = upgrades[catalog->next];
+
+		catalog->next_script = write_upgrade(xml, upgrade, catalog->next == 0, catalog->next_script, catalog_chunk_size);
+
+		if(catalog->next_script == upgrade.scripts.size())
+		{
+			++catalog->next;
+			catalog->next_script = 0;
+		}
+	}
+
+	if(catalog->next == upgrades.size())
+	{
+		write_catalog_end(xml);
+		catalog->finished = true;
+	}
+
+	asio::async_write(stream_, http::make_chunk(asio::buffer(xml)), beast::bind_front_handler(&http_session::write_catalog, shared_from_this(), catalog));
+}
+
+http_session::query_params::query_params(std::string_view query_string)
+{
+	// decoded values are never longer than the query string, so views into decoded_ stay valid
+	if(query_string.find_first_of("%+") != std::string_view::npos)
+	{
+		decoded_.reserve(query_string.size());
+	}
+
+	while(!query_string.empty())
+	{
+		const auto ampersand = query_string.find('&');
+		const auto param = query_string.substr(0, ampersand);
+
+		query_string.remove_prefix(ampersand == std::string_view::npos ? query_string.size() : ampersand + 1);
+
+		if(param.empty())
+		{
+			continue;
+		}
+
+		const auto equals = param.find('=');
+		const auto name = decode(param.substr(0, equals));
+		const auto value = equals == std::string_view::npos ? std::string_view{} : decode(param.substr(equals + 1));
+
+		params_.emplace_back(name, value);
+	}
+}
+
+std::string_view http_session::query_params::decode(std::string_view value)
+{
+	if(value.find_first_of("%+") == std::string_view::npos)
+	{
+		return value;
+	}
+
+	const auto first = decoded_.size();
+
+	for(std::size_t i = 0; i < value.size(); ++i)
+	{
+		const auto c = value[i];
+
+		if(c == '+')
+		{
+			decoded_ += ' ';
+			continue;
+		}
+
+		auto byte = 0u;
+
+		if(c == '%' && i + 2 < value.size() && std::from_chars(value.data() + i + 1, value.data() + i + 3, byte, 16).ptr == value.data() + i + 3)
+		{
+			decoded_ += static_cast<char>(byte);
+			i += 2;
+			continue;
+		}
+
+		decoded_ += c;
+	}
+
+	return {decoded_.data() + first, decoded_.size() - first};
+}
+
+int http_session::query_params::get(std::string_view name, int default_value) const
+{
+	const auto value = get(name, std::string_view{});
+
+	auto result = 0;
+	const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+
+	return value.empty() || ec != std::errc{} || end != value.data() + value.size() ? default_value : result;
+}
+
+std::string_view http_session::query_params::get(std::string_view name, std::string_view default_value) const
+{
+	for(const auto &[param_name, value] : params_)
+	{
+		if(param_name == name)
+		{
+			return value;
+		}
+	}
+
+	return default_value;
+}
+
+std::vector<std::string_view> http_session::query_params::get_all(std::string_view name) const
 {
-	send(http::status::ok, response.dump(2), "application/json");
+	std::vector<std::string_view> values;
+
+	for(const auto &[param_name, value] : params_)
+	{
+		if(param_name == name)
+		{
+			values.emplace_back(value);
+		}
+	}
+
+	return values;
 }
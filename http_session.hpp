@@ -1,33 +1,85 @@
 #pragma once
 
-#include <regex>
+#include <optional>
+#include <string_view>
 
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/thread_pool.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 
+#include "commit_parser.hpp"
 #include "json.hpp"
 
+class json_writer;
 class kitman;
+struct upgrade;
 
 class http_session : public std::enable_shared_from_this<http_session>
 {
 public:
-	http_session(boost::asio::ip::tcp::socket &&socket, const std::string &web_root, kitman &kitman);
+	http_session(boost::asio::ip::tcp::socket &&socket, boost::asio::thread_pool::executor_type db_executor, std::uint64_t max_body_size, const std::string &web_root, kitman &kitman);
 
 	void run();
 
 private:
-	using handler = void(http_session::*)(const std::cmatch &, const nlohmann::json &);
-	using route = std::tuple<handler, boost::beast::http::verb, std::regex>;
+	// parts of the request target a route extracts, they point into the request
+	struct route_params
+	{
+		std::string_view stream;
+		std::string_view query_string;
+	};
+
+	// decoded name/value pairs of a query string in order, values without escapes point into the request
+	class query_params
+	{
+	public:
+		explicit query_params(std::string_view query_string);
+
+		query_params(const query_params &) = delete;
+		query_params &operator=(const query_params &) = delete;
+
+		int get(std::string_view name, int default_value) const;
+		std::string_view get(std::string_view name, std::string_view default_value) const;
+		std::vector<std::string_view> get_all(std::string_view name) const;
+
+	private:
+		std::string decoded_;
+		std::vector<std::tuple<std::string_view, std::string_view>> params_;
+
+		std::string_view decode(std::string_view value);
+	};
 
+	using handler = void(http_session::*)(const route_params &);
+
+	// pattern segments are matched literally except {stream}, which matches any one segment
+	using route = std::tuple<handler, boost::beast::http::verb, std::string_view>;
+
+	// catalog sent to HTTP/1.1 clients with chunked encoding, the next chunk resumes at script next_script of upgrade next
+	struct catalog_response
+	{
+		boost::beast::http::response<boost::beast::http::empty_body> response;
+		boost::beast::http::response_serializer<boost::beast::http::empty_body> serializer{response};
+		std::shared_ptr<const std::vector<upgrade>> upgrades;
+		std::size_t next = 0;
+		std::size_t next_script = 0;
+		bool finished = false;
+		std::string xml;
+	};
+
+	static constexpr std::size_t catalog_chunk_size = 64 * 1024;
 	static const route routes_[];
 
 	boost::beast::tcp_stream stream_;
+	boost::asio::thread_pool::executor_type db_executor_;
 	std::string web_root_;
 	kitman &kitman_;
 	boost::beast::flat_buffer buffer_;
+	std::uint64_t max_body_size_;
+	std::optional<boost::beast::http::request_parser<boost::beast::http::string_body>> parser_;
 	boost::beast::http::request<boost::beast::http::string_body> request_;
 	std::shared_ptr<void> response_;
+	commit_parser commit_parser_;
 
 	void close();
 	bool handle_request();
@@ -36,22 +88,24 @@ private:
 	bool handle_web_root();
 	void on_read(const boost::beast::error_code &ec, std::size_t);
 	void on_write(bool close, const boost::beast::error_code &ec, std::size_t);
+	nlohmann::json parse_body() const;
 	void read();
-	void send(boost::beast::http::status status, const std::string &body = "", const char *content_type = nullptr);
+	void run_handler(handler handler, const route_params &params);
+	void send(boost::beast::http::status status, std::string &&body = "", const char *content_type = nullptr);
 	void send(boost::beast::http::status status, boost::beast::http::file_body::value_type &&body, const char *content_type);
-	void send_json(const nlohmann::json &response);
-
-	void commit_files(const std::cmatch &params, const nlohmann::json &body);
-	void create_stream(const std::cmatch &params, const nlohmann::json &body);
-	void create_tag(const std::cmatch &params, const nlohmann::json &body);
-	void delete_stream(const std::cmatch &params, const nlohmann::json &body);
-	void get_catalog(const std::cmatch &params, const nlohmann::json &body);
-	void get_commits(const std::cmatch &params, const nlohmann::json &body);
-	void get_paths(const std::cmatch &params, const nlohmann::json &body);
-	void get_streams(const std::cmatch &params, const nlohmann::json &body);
-	void merge(const std::cmatch &params, const nlohmann::json &body);
+	void send_catalog(std::shared_ptr<const std::vector<upgrade>> upgrades);
+	void send_json(json_writer &json);
+	void write_catalog(std::shared_ptr<catalog_response> catalog, const boost::beast::error_code &ec, std::size_t);
 
-	static std::map<std::string, std::string> parse_query_string(const std::string &query_string);
+	void commit_files(const route_params &params);
+	void create_stream(const route_params &params);
+	void create_tag(const route_params &params);
+	void delete_stream(const route_params &params);
+	void get_catalog(const route_params &params);
+	void get_commits(const route_params &params);
+	void get_paths(const route_params &params);
+	void get_streams(const route_params &params);
+	void merge(const route_params &params);
 
 	template
 	<
@@ -63,7 +117,12 @@ private:
 		namespace http = boost::beast::http;
 
 		auto response_ptr = std::make_shared<Response>(std::move(response));
-		response_ = response_ptr;
-		http::async_write(stream_, *response_ptr, beast::bind_front_handler(&http_session::on_write, shared_from_this(), response_ptr->need_eof()));
+
+		// REST handlers run on the database pool, the write has to start on the session's strand
+		boost::asio::dispatch(stream_.get_executor(), [self = shared_from_this(), response_ptr]
+		{
+			self->response_ = response_ptr;
+			http::async_write(self->stream_, *response_ptr, beast::bind_front_handler(&http_session::on_write, self, response_ptr->need_eof()));
+		});
 	}
 };
@@ -0,0 +1,171 @@
+#include "json_writer.hpp"
+
+#include <charconv>
+
+json_writer::json_writer(bool pretty)
+	: pretty_{pretty}
+{
+}
+
+void json_writer::begin_array()
+{
+	begin_value();
+	json_ += '[';
+	empty_.emplace_back(true);
+}
+
+void json_writer::begin_object()
+{
+	begin_value();
+	json_ += '{';
+	empty_.emplace_back(true);
+}
+
+void json_writer::begin_value()
+{
+	if(after_key_)
+	{
+		after_key_ = false;
+		return;
+	}
+
+	if(empty_.empty())
+	{
+		return;
+	}
+
+	if(!empty_.back())
+	{
+		json_ += ',';
+	}
+
+	empty_.back() = false;
+
+	if(pretty_)
+	{
+		json_ += '\n';
+		json_.append(2 * empty_.size(), ' ');
+	}
+}
+
+void json_writer::boolean(bool value)
+{
+	begin_value();
+	json_ += value ? "true" : "false";
+}
+
+void json_writer::end(char c)
+{
+	const auto empty = empty_.back();
+
+	empty_.pop_back();
+
+	if(pretty_ && !empty)
+	{
+		json_ += '\n';
+		json_.append(2 * empty_.size(), ' ');
+	}
+
+	json_ += c;
+}
+
+void json_writer::end_array()
+{
+	end(']');
+}
+
+void json_writer::end_object()
+{
+	end('}');
+}
+
+void json_writer::key(std::string_view name)
+{
+	begin_value();
+	write_string(name);
+	json_ += pretty_ ? ": " : ":";
+	after_key_ = true;
+}
+
+void json_writer::null()
+{
+	begin_value();
+	json_ += "null";
+}
+
+void json_writer::number(int value)
+{
+	char digits[16];
+	const auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+
+	begin_value();
+	json_.append(digits, end);
+}
+
+std::string json_writer::release()
+{
+	return std::move(json_);
+}
+
+void json_writer::string(std::string_view value)
+{
+	begin_value();
+	write_string(value);
+}
+
+void json_writer::write_string(std::string_view value)
+{
+	constexpr auto hex_digits = "0123456789abcdef";
+
+	json_ += '"';
+
+	for(const auto c : value)
+	{
+		switch(c)
+		{
+		case '"':
+			json_ += "\\\"";
+			break;
+
+		case '\\':
+			json_ += "\\\\";
+			break;
+
+		case '\b':
+			json_ += "\\b";
+			break;
+
+		case '\f':
+			json_ += "\\f";
+			break;
+
+		case '\n':
+			json_ += "\\n";
+			break;
+
+		case '\r':
+			json_ += "\\r";
+			break;
+
+		case '\t':
+			json_ += "\\t";
+			break;
+
+		default:
+			if(static_cast<unsigned char>(c) < 0x20)
+			{
+				json_ += "\\u00";
+				json_ += hex_digits[c >> 4];
+				json_ += hex_digits[c & 0xf];
+			}
+			else
+			{
+				json_ += c;
+			}
+
+			break;
+		}
+	}
+
+	json_ += '"';
+}
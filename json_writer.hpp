@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// writes JSON text directly, laid out like nlohmann::json::dump(2) when pretty and like dump() otherwise
+class json_writer
+{
+public:
+	explicit json_writer(bool pretty);
+
+	void begin_array();
+	void begin_object();
+	void end_array();
+	void end_object();
+	void key(std::string_view name);
+
+	void boolean(bool value);
+	void null();
+	void number(int value);
+	void string(std::string_view value);
+
+	std::string release();
+
+private:
+	std::string json_;
+	bool pretty_;
+	bool after_key_ = false;
+
+	// whether each open array or object is still empty
+	std::vector<bool> empty_;
+
+	void begin_value();
+	void end(char c);
+	void write_string(std::string_view value);
+};
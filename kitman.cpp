@@ -1,34 +1,217 @@
 #include "kitman.hpp"
 
+#include <algorithm>
+#include <unordered_map>
+
 #include <boost/format.hpp>
 
 #include "catalog_generator.hpp"
 #include "utils.hpp"
 
-kitman::kitman(const char *db_path)
-	: db_{db_path}
+constexpr auto batch_size = 256;
+constexpr std::size_t max_cached_catalogs = 64;
+
+kitman::kitman(const char *db_path, const database_settings &settings, unsigned max_readers)
+	: db_path_{db_path}, settings_{settings}, db_{db_path, settings}, max_readers_{max_readers}
 {
 	init_db();
 	prepare_statements();
+	load_graph();
+}
+
+bool kitman::add_column(const char *table, const char *column, const char *definition)
+{
+	statement stmt;
+
+	stmt.prepare(db_, "SELECT COUNT(*) FROM pragma_table_info(?) WHERE name = ?");
+	stmt.bind(table, column);
+	stmt.step();
+
+	if(stmt.get_int(0))
+	{
+		return false;
+	}
+
+	stmt.prepare(db_, (boost::format("ALTER TABLE %1% ADD COLUMN %2% %3%") % table % column % definition).str().data()).exec();
+
+	return true;
+}
+
+void kitman::add_commit_last_tag_id()
+{
+	if(!add_column("commits", "last_tag_id", "INTEGER REFERENCES tags(id)"))
+	{
+		return;
+	}
+
+	std::vector<std::tuple<int, int>> last_tags;
+	std::unordered_map<int, int> last_tag_ids;
+
+	statement stmt;
+
+	stmt.prepare(db_, R"(
+		SELECT
+			c.id, c.parent, MAX(t.id)
+		FROM
+			commits c
+			LEFT JOIN tags t ON (t.commit_id = c.id)
+		GROUP BY
+			c.id
+		ORDER BY
+			c.id
+	)");
+
+	while(stmt.step())
+	{
+		const auto commit_id = stmt.get_int(0);
+		auto last_tag_id = stmt.get_int(2);
+
+		if(!last_tag_id)
+		{
+			last_tag_id = last_tag_ids[stmt.get_int(1)];
+		}
+
+		if(last_tag_id)
+		{
+			last_tag_ids[commit_id] = last_tag_id;
+			last_tags.emplace_back(commit_id, last_tag_id);
+		}
+	}
+
+	stmt.prepare(db_, "UPDATE commits SET last_tag_id = ? WHERE id = ?");
+
+	for(const auto &[commit_id, last_tag_id] : last_tags)
+	{
+		stmt.exec(last_tag_id, commit_id);
+	}
+}
+
+void kitman::add_commit_stream_id()
+{
+	if(!add_column("commits", "stream_id", "INTEGER"))
+	{
+		return;
+	}
+
+	std::vector<std::tuple<int, int>> stream_commits;
+
+	statement stmt;
+
+	stmt.prepare(db_, R"(
+		WITH RECURSIVE in_path(id, stream_id) AS (
+			SELECT head, id FROM streams
+			UNION ALL
+			SELECT
+				c.parent, ip.stream_id
+			FROM
+				commits c
+				JOIN in_path ip ON (ip.id = c.id)
+			WHERE
+				c.parent IS NOT NULL
+		)
+		SELECT id, stream_id FROM in_path
+	)");
+
+	while(stmt.step())
+	{
+		stream_commits.emplace_back(stmt.get_int(0), stmt.get_int(1));
+	}
+
+	stmt.prepare(db_, "UPDATE commits SET stream_id = ? WHERE id = ?");
+
+	for(const auto &[commit_id, stream_id] : stream_commits)
+	{
+		stmt.exec(stream_id, commit_id);
+	}
+}
+
+std::unique_ptr<kitman::reader> kitman::borrow_reader()
+{
+	std::unique_lock lock{readers_mutex_};
+
+	readers_available_.wait(lock, [this]
+	{
+		return !readers_.empty() || open_readers_ < max_readers_;
+	});
+
+	if(readers_.empty())
+	{
+		++open_readers_;
+		lock.unlock();
+
+		try
+		{
+			return std::make_unique<reader>(db_path_.data(), settings_);
+		}
+		catch(...)
+		{
+			lock.lock();
+			--open_readers_;
+			readers_available_.notify_one();
+			throw;
+		}
+	}
+
+	auto reader = std::move(readers_.back());
+	readers_.pop_back();
+
+	return reader;
 }
 
 void kitman::commit_files(const std::string &stream, const std::string &comment, const std::vector<file> &files)
 {
+	std::unique_lock lock{mutex_};
 	transaction tx{db_};
 
-	const auto head = get_head(stream);
-	const auto commit_id = insert_commit_.exec(head, comment);
+	select_stream_.exec(stream);
+
+	const auto stream_id = select_stream_.get_int(0);
+	const auto head = select_stream_.get_int(1);
+	const auto last_tag_id = graph_.get_last_tag_id(head);
+	const auto commit_id = insert_commit_.exec(head, comment, stream_id, last_tag_id);
 
-	for(auto i = 0u; i < files.size(); ++i)
+	// full batches reuse the prepared statement, only the last partial one is prepared here
+	for(std::size_t first = 0; first < files.size(); first += batch_size)
 	{
-		insert_commit_file_.exec(commit_id, i, files[i].path, files[i].is_delete);
+		const auto count = std::min<std::size_t>(batch_size, files.size() - first);
+
+		if(count == batch_size)
+		{
+			insert_commit_files(insert_commit_files_, commit_id, files, first, count);
+		}
+		else
+		{
+			statement stmt;
+			insert_commit_files(stmt.prepare(db_, get_insert_commit_files_sql(count).data()), commit_id, files, first, count);
+		}
 	}
 
 	update_stream_.exec(commit_id, stream);
+
+	graph_.add_commit(commit_id, head, 0, last_tag_id);
+}
+
+void kitman::create_commit_stream_indexes()
+{
+	statement stmt;
+
+	stmt.prepare(db_, "CREATE INDEX IF NOT EXISTS commits_stream_id ON commits(stream_id, id)").exec();
+	stmt.prepare(db_, "CREATE INDEX IF NOT EXISTS commits_stream_comment ON commits(stream_id, comment, id)").exec();
+}
+
+void kitman::create_lookup_indexes()
+{
+	statement stmt;
+
+	stmt.prepare(db_, "CREATE INDEX IF NOT EXISTS commits_parent ON commits(parent)").exec();
+	stmt.prepare(db_, "CREATE INDEX IF NOT EXISTS commits_merge_from ON commits(merge_from)").exec();
+	stmt.prepare(db_, "CREATE INDEX IF NOT EXISTS streams_parent ON streams(parent)").exec();
+	stmt.prepare(db_, "CREATE INDEX IF NOT EXISTS tags_commit_id ON tags(commit_id)").exec();
 }
 
 void kitman::create_stream(const std::string &name, const std::string &parent, const std::string &tag)
 {
+	std::unique_lock lock{mutex_};
 	transaction tx{db_};
 
 	std::optional<int> parent_id;
@@ -42,7 +225,7 @@ void kitman::create_stream(const std::string &name, const std::string &parent, c
 		parent_id = select_stream_.get_int(0);
 		parent_head = select_stream_.get_int(1);
 
-		comment = (boost::format("Add stream (from %1%, ID %2%)") % parent % *parent_head).str();
+		comment = "Add stream (from " + parent + ", ID " + std::to_string(*parent_head) + ')';
 	}
 	else
 	{
@@ -50,31 +233,120 @@ void kitman::create_stream(const std::string &name, const std::string &parent, c
 	}
 
 	const auto commit_id = insert_create_commit_.exec(parent_head, comment);
+	const auto stream_id = insert_stream_.exec(name, parent_id, commit_id);
 
-	insert_stream_.exec(name, parent_id, commit_id);
+	update_commit_stream_.exec(stream_id, commit_id);
+
+	auto tag_id = 0;
 
 	if(!tag.empty())
 	{
-		insert_tag_.exec(tag, commit_id);
+		tag_id = insert_tag_.exec(tag, commit_id);
+		update_commit_last_tag_.exec(tag_id, commit_id);
+	}
+
+	graph_.add_commit(commit_id, 0, parent_head.value_or(0), tag_id);
+
+	if(tag_id)
+	{
+		graph_.add_tag(tag_id, tag, commit_id);
 	}
 }
 
 void kitman::create_tag(const std::string &stream, const std::string &tag)
 {
-	insert_tag_for_stream_.exec(tag, stream);
+	std::unique_lock lock{mutex_};
+	transaction tx{db_};
+
+	select_stream_.exec(stream);
+
+	const auto head = select_stream_.get_int(1);
+
+	if(!head)
+	{
+		return;
+	}
+
+	const auto tag_id = insert_tag_.exec(tag, head);
+
+	update_commit_last_tag_.exec(tag_id, head);
+
+	graph_.add_tag(tag_id, tag, head);
+	catalogs_.clear();
+}
+
+void kitman::create_tables()
+{
+	statement stmt;
+
+	stmt.prepare(db_, R"(
+		CREATE TABLE IF NOT EXISTS commits (
+			id INTEGER PRIMARY KEY AUTOINCREMENT,
+			parent INTEGER REFERENCES commits(id),
+			merge_from INTEGER REFERENCES commits(id),
+			comment TEXT,
+			date TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
+			stream_id INTEGER,
+			last_tag_id INTEGER REFERENCES tags(id)
+		)
+	)").exec();
+
+	stmt.prepare(db_, R"(
+		CREATE TABLE IF NOT EXISTS commit_files (
+			id INTEGER PRIMARY KEY AUTOINCREMENT,
+			commit_id INTEGER NOT NULL REFERENCES commits(id),
+			seq INTEGER NOT NULL,
+			path TEXT NOT NULL,
+			is_delete INTEGER NOT NULL,
+
+			UNIQUE(commit_id, seq),
+			UNIQUE(commit_id, path)
+		)
+	)").exec();
+
+	stmt.prepare(db_, R"(
+		CREATE TABLE IF NOT EXISTS streams (
+			id INTEGER PRIMARY KEY AUTOINCREMENT,
+			name TEXT NOT NULL UNIQUE,
+			parent INTEGER REFERENCES streams(id),
+			head INTEGER NOT NULL REFERENCES commits(id)
+		)
+	)").exec();
+
+	stmt.prepare(db_, R"(
+		CREATE TABLE IF NOT EXISTS tags (
+			id INTEGER PRIMARY KEY AUTOINCREMENT,
+			name TEXT NOT NULL UNIQUE,
+			commit_id INTEGER NOT NULL REFERENCES commits(id)
+		)
+	)").exec();
 }
 
 void kitman::delete_stream(const std::string &name)
 {
+	std::unique_lock lock{mutex_};
 	transaction tx{db_};
 
-	delete_tags_.exec(name);
+	select_stream_.exec(name);
+
+	const auto stream_id = select_stream_.get_int(0);
+	const auto head = select_stream_.get_int(1);
+
+	clear_stream_last_tags_.exec(stream_id);
+
+	for(const auto tag_id : graph_.get_stream_tags(head))
+	{
+		delete_tag_.exec(tag_id);
+	}
+
 	delete_stream_.exec(name);
+
+	graph_.remove_stream_tags(head);
+	catalogs_.clear();
 }
 
-std::vector<upgrade> kitman::get_catalog(const std::string &stream, std::vector<std::string> &paths)
+std::vector<upgrade> kitman::generate_catalog(int head, std::vector<std::string> &paths, std::vector<bool> &reachable)
 {
-	const auto head = get_head(stream);
 	const auto &last_tag = get_last_tag(head);
 
 	if(std::find(paths.cbegin(), paths.cend(), last_tag) == paths.cend())
@@ -86,7 +358,7 @@ std::vector<upgrade> kitman::get_catalog(const std::string &stream, std::vector<
 
 	catalog_generator generator{*this, head};
 
-	auto upgrades = generator.generate(paths);
+	auto upgrades = generator.generate(paths, reachable);
 
 	for(auto &upgrade : upgrades)
 	{
@@ -98,148 +370,203 @@ std::vector<upgrade> kitman::get_catalog(const std::string &stream, std::vector<
 	return upgrades;
 }
 
-int kitman::get_commit(const std::string &tag)
+std::shared_ptr<const std::vector<upgrade>> kitman::get_catalog(const std::string &stream, std::vector<std::string> &paths)
 {
-	select_tag_commit_.bind(tag);
-	select_tag_commit_.step();
-
-	return select_tag_commit_.get_int(0);
-}
+	std::shared_lock lock{mutex_};
 
-std::vector<path_commit> kitman::get_commits(int head)
-{
-	std::vector<path_commit> commits;
+	const auto head = get_head(stream);
+	const auto key = std::make_tuple(stream, paths);
 
-	select_path_commits_.bind(head);
+	std::shared_ptr<const cached_catalog> cached;
 
-	while(select_path_commits_.step())
 	{
-		commits.emplace_back
-		(
-			select_path_commits_.get_int(0), select_path_commits_.get_int(1), select_path_commits_.get_int(2)
-		);
+		std::lock_guard catalogs_lock{catalogs_mutex_};
+
+		if(const auto it = catalogs_.find(key); it != catalogs_.end())
+		{
+			cached = it->second.catalog;
+			it->second.last_use = ++catalogs_use_;
+		}
 	}
 
-	return commits;
-}
+	if(!cached || cached->head != head)
+	{
+		auto catalog = std::make_shared<cached_catalog>();
 
-std::tuple<int, std::vector<commit>> kitman::get_commits(const std::string &stream, const std::string &sort, const std::string &order, int page, int page_size)
-{
-	statement *stmt;
+		catalog->head = head;
 
-	if(sort == "comment")
-	{
-		if(order == "asc")
+		if(const auto &commits = cached ? graph_.get_commits_since(cached->head, head) : std::nullopt)
 		{
-			stmt = &select_commits_comment_asc_;
+			catalog->paths = cached->paths;
+			catalog->upgrades = cached->upgrades;
+			catalog->reachable = cached->reachable;
+
+			catalog_generator{*this, head}.extend(catalog->upgrades, catalog->reachable, *commits);
 		}
 		else
 		{
-			stmt = &select_commits_comment_desc_;
+			catalog->paths = paths;
+			catalog->upgrades = generate_catalog(head, catalog->paths, catalog->reachable);
 		}
-	}
-	else
-	{
-		if(order == "asc")
-		{
-			stmt = &select_commits_id_asc_;
-		}
-		else
+
+		std::lock_guard catalogs_lock{catalogs_mutex_};
+
+		catalogs_.insert_or_assign(key, catalog_entry{catalog, ++catalogs_use_});
+		cached = catalog;
+
+		// every distinct paths query gets an entry, so drop the least recently used one past the limit
+		if(catalogs_.size() > max_cached_catalogs)
 		{
-			stmt = &select_commits_id_desc_;
+			const auto oldest = std::min_element(catalogs_.cbegin(), catalogs_.cend(), [](const auto &x, const auto &y)
+			{
+				return x.second.last_use < y.second.last_use;
+			});
+
+			catalogs_.erase(oldest);
 		}
 	}
 
-	auto total = 0;
-	std::vector<commit> commits;
+	paths = cached->paths;
 
-	stmt->bind(stream, page_size, page * page_size);
+	// shares the cached catalog instead of copying it, it stays alive while the caller holds it
+	return {cached, &cached->upgrades};
+}
 
-	while(stmt->step())
-	{
-		total = stmt->get_int(0);
+int kitman::get_commit(const std::string &tag)
+{
+	reader_lease reader{*this};
 
-		auto &commit = commits.emplace_back(stmt->get_int(1), stmt->get_text(3), stmt->get_text(4));
+	reader->select_tag_commit.bind(tag);
+	reader->select_tag_commit.step();
 
-		if(const auto merge_from = stmt->get_int(2))
-		{
-			commit.merge_from_tag = get_last_tag(merge_from);
-		}
+	return reader->select_tag_commit.get_int(0);
+}
 
-		commit.tags = get_tags(commit.id);
-		commit.files = get_files(commit.id);
-	}
+std::vector<path_commit> kitman::get_commits(int head)
+{
+	return graph_.get_commits(head);
+}
+
+std::tuple<int, std::vector<commit>> kitman::get_commits(const std::string &stream, const std::string &sort, const std::string &order, int page, int page_size)
+{
+	std::shared_lock lock{mutex_};
+
+	const auto total = graph_.get_depth(get_head(stream));
+
+	reader_lease reader{*this};
+
+	auto &stmt = reader->get_commits_statement(sort, order, false);
+
+	stmt.bind(stream, page_size, page * page_size);
 
-	return {total, commits};
+	return {total, read_commits(*reader, stmt)};
 }
 
-std::vector<file> kitman::get_files(int commit_id)
+std::tuple<int, std::vector<commit>> kitman::get_commits_after(const std::string &stream, const std::string &sort, const std::string &order, int after, int page_size)
 {
-	std::vector<file> files;
+	std::shared_lock lock{mutex_};
 
-	select_commit_files_.bind(commit_id);
+	const auto total = graph_.get_depth(get_head(stream));
 
-	while(select_commit_files_.step())
+	reader_lease reader{*this};
+
+	auto &stmt = reader->get_commits_statement(sort, order, true);
+
+	stmt.bind(stream, after, page_size);
+
+	return {total, read_commits(*reader, stmt)};
+}
+
+void kitman::get_files(const std::vector<int> &commit_ids, const std::function<void(int, std::string_view, bool)> &on_file)
+{
+	reader_lease reader{*this};
+
+	for(auto first = commit_ids.cbegin(); first != commit_ids.cend();)
 	{
-		files.emplace_back(select_commit_files_.get_text(0), select_commit_files_.get_int(1));
-	}
+		const auto last = first + std::min<std::ptrdiff_t>(batch_size, commit_ids.cend() - first);
+
+		reader->select_batch_files.bind_range(first, last);
 
-	return files;
+		while(reader->select_batch_files.step())
+		{
+			on_file(reader->select_batch_files.get_int(0), intern(reader->select_batch_files.get_text(1)), reader->select_batch_files.get_int(2));
+		}
+
+		first = last;
+	}
 }
 
 int kitman::get_head(const std::string &stream)
 {
-	select_stream_.exec(stream);
-	return select_stream_.get_int(1);
+	reader_lease reader{*this};
+
+	reader->select_stream.exec(stream);
+	return reader->select_stream.get_int(1);
 }
 
-std::string kitman::get_last_tag(int commit_id)
+std::string kitman::get_insert_commit_files_sql(std::size_t count)
 {
-	select_last_tag_.bind(commit_id);
+	// the commit id is bound once as ?1, each row then takes the next three parameters
+	std::string sql{"INSERT INTO commit_files (commit_id, seq, path, is_delete) VALUES (?1, ?, ?, ?)"};
 
-	if(select_last_tag_.step())
+	for(std::size_t i = 1; i < count; ++i)
 	{
-		return select_last_tag_.get_text(0);
+		sql += ", (?1, ?, ?, ?)";
 	}
 
-	return {};
+	return sql;
 }
 
-std::vector<std::string> kitman::get_paths(const std::string &stream)
+std::string kitman::get_last_tag(int commit_id)
 {
-	std::vector<std::string> paths;
-
-	const auto head = get_head(stream);
+	return graph_.get_last_tag(commit_id);
+}
 
-	select_paths_.bind(head);
+std::vector<std::string> kitman::get_paths(const std::string &stream)
+{
+	std::shared_lock lock{mutex_};
 
-	while(select_paths_.step())
-	{
-		paths.emplace_back(select_paths_.get_text(0));
-	}
+	auto paths = graph_.get_paths(get_head(stream));
 
 	sort_tags(paths);
 
 	return paths;
 }
 
+database_settings kitman::get_settings()
+{
+	std::unique_lock lock{mutex_};
+	reader_lease reader{*this};
+
+	auto settings = db_.get_settings();
+
+	settings.reader_cache_size = reader->db.get_settings().cache_size;
+
+	return settings;
+}
+
 std::vector<stream> kitman::get_streams()
 {
+	std::shared_lock lock{mutex_};
+	reader_lease reader{*this};
+
 	std::vector<stream> streams;
 
-	select_streams_.reset();
+	auto &select_streams = reader->select_streams;
+
+	select_streams.reset();
 
-	while(select_streams_.step())
+	while(select_streams.step())
 	{
-		const auto id = select_streams_.get_int(0);
-		const auto name = select_streams_.get_text(1);
-		const auto head = select_streams_.get_int(2);
-		const auto parent = select_streams_.get_text(3);
-		const auto child = select_streams_.get_text(4);
+		const auto id = select_streams.get_int(0);
+		const auto name = select_streams.get_text(1);
+		const auto tag = select_streams.get_text(2);
+		const auto parent = select_streams.get_text(3);
+		const auto child = select_streams.get_text(4);
 
 		if(streams.empty() || streams.back().id != id)
 		{
-			auto &stream = streams.emplace_back(id, name, get_last_tag(head));
+			auto &stream = streams.emplace_back(id, name, tag);
 
 			if(parent)
 			{
@@ -260,210 +587,287 @@ std::vector<stream> kitman::get_streams()
 	return streams;
 }
 
-std::vector<std::string> kitman::get_tags(int commit_id)
+void kitman::init_db()
 {
-	std::vector<std::string> tags;
+	// applied in order, PRAGMA user_version counts how many a database has seen
+	static const migration migrations[]
+	{
+		&kitman::create_tables,
+		&kitman::add_commit_stream_id,
+		&kitman::add_commit_last_tag_id,
+		&kitman::create_commit_stream_indexes,
+		&kitman::create_lookup_indexes
+	};
+
+	const auto latest_version = static_cast<int>(std::size(migrations));
+
+	transaction tx{db_};
+
+	statement stmt;
 
-	select_tags_.bind(commit_id);
+	stmt.prepare(db_, "PRAGMA foreign_keys = ON").exec();
+
+	stmt.prepare(db_, "PRAGMA user_version").step();
 
-	while(select_tags_.step())
+	auto version = stmt.get_int(0);
+
+	if(version > latest_version)
 	{
-		tags.emplace_back(select_tags_.get_text(0));
+		throw exception{(boost::format("database schema version %1% is newer than the supported version %2%") % version % latest_version).str()};
 	}
 
-	return tags;
+	if(version == latest_version)
+	{
+		return;
+	}
+
+	for(; version < latest_version; ++version)
+	{
+		(this->*migrations[version])();
+	}
+
+	stmt.prepare(db_, (boost::format("PRAGMA user_version = %1%") % latest_version).str().data()).exec();
 }
 
-void kitman::init_db()
+void kitman::insert_commit_files(statement &stmt, int commit_id, const std::vector<file> &files, std::size_t first, std::size_t count)
 {
-	transaction tx{db_};
+	stmt.reset();
+	stmt.bind_at(1, commit_id);
 
-	statement stmt;
+	for(std::size_t i = 0; i < count; ++i)
+	{
+		const auto &file = files[first + i];
+		stmt.bind_at(static_cast<int>(2 + 3 * i), static_cast<int>(first + i), file.path, file.is_delete);
+	}
 
-	stmt.prepare(db_, "PRAGMA foreign_keys = ON").exec();
+	stmt.step();
+}
 
-	stmt.prepare(db_, R"(
-		CREATE TABLE IF NOT EXISTS commits (
-			id INTEGER PRIMARY KEY AUTOINCREMENT,
-			parent INTEGER REFERENCES commits(id),
-			merge_from INTEGER REFERENCES commits(id),
-			comment TEXT,
-			date TIMESTAMP DEFAULT CURRENT_TIMESTAMP
-		)
-	)").exec();
+std::string_view kitman::intern(std::string_view value)
+{
+	return strings_.intern(value);
+}
 
-	stmt.prepare(db_, R"(
-		CREATE TABLE IF NOT EXISTS commit_files (
-			id INTEGER PRIMARY KEY AUTOINCREMENT,
-			commit_id INTEGER NOT NULL REFERENCES commits(id),
-			seq INTEGER NOT NULL,
-			path TEXT NOT NULL,
-			is_delete INTEGER NOT NULL,
+void kitman::load_details(reader &reader, std::vector<commit> &commits)
+{
+	std::unordered_map<int, commit *> commits_by_id;
+	std::vector<int> commit_ids;
 
-			UNIQUE(commit_id, seq),
-			UNIQUE(commit_id, path)
-		)
-	)").exec();
+	for(auto &commit : commits)
+	{
+		commits_by_id.emplace(commit.id, &commit);
+		commit_ids.emplace_back(commit.id);
+	}
 
-	stmt.prepare(db_, R"(
-		CREATE TABLE IF NOT EXISTS streams (
-			id INTEGER PRIMARY KEY AUTOINCREMENT,
-			name TEXT NOT NULL UNIQUE,
-			parent INTEGER REFERENCES streams(id),
-			head INTEGER NOT NULL REFERENCES commits(id)
-		)
-	)").exec();
+	for(auto first = commit_ids.cbegin(); first != commit_ids.cend();)
+	{
+		const auto last = first + std::min<std::ptrdiff_t>(batch_size, commit_ids.cend() - first);
 
-	stmt.prepare(db_, R"(
-		CREATE TABLE IF NOT EXISTS tags (
-			id INTEGER PRIMARY KEY AUTOINCREMENT,
-			name TEXT NOT NULL UNIQUE,
-			commit_id INTEGER NOT NULL REFERENCES commits(id)
-		)
-	)").exec();
+		reader.select_batch_tags.bind_range(first, last);
+
+		while(reader.select_batch_tags.step())
+		{
+			commits_by_id[reader.select_batch_tags.get_int(0)]->tags.emplace_back(intern(reader.select_batch_tags.get_text(1)));
+		}
+
+		reader.select_batch_files.bind_range(first, last);
+
+		while(reader.select_batch_files.step())
+		{
+			commits_by_id[reader.select_batch_files.get_int(0)]->files.emplace_back(intern(reader.select_batch_files.get_text(1)), reader.select_batch_files.get_int(2));
+		}
+
+		first = last;
+	}
+}
+
+void kitman::load_graph()
+{
+	statement stmt;
+
+	stmt.prepare(db_, "SELECT id, parent, merge_from, last_tag_id FROM commits ORDER BY id");
+
+	while(stmt.step())
+	{
+		graph_.add_commit(stmt.get_int(0), stmt.get_int(1), stmt.get_int(2), stmt.get_int(3));
+	}
+
+	stmt.prepare(db_, "SELECT id, name, commit_id FROM tags ORDER BY id");
+
+	while(stmt.step())
+	{
+		graph_.add_tag(stmt.get_int(0), stmt.get_text(1), stmt.get_int(2));
+	}
 }
 
 void kitman::merge(const std::string &from, const std::string &to)
 {
+	std::unique_lock lock{mutex_};
 	transaction tx{db_};
 
-	const auto from_head = get_head(from);
-	const auto to_head = get_head(to);
+	select_stream_.exec(from);
+
+	const auto from_head = select_stream_.get_int(1);
+
+	select_stream_.exec(to);
+
+	const auto stream_id = select_stream_.get_int(0);
+	const auto to_head = select_stream_.get_int(1);
 
-	const auto &comment = (boost::format("Merge from %1%  (ID %2%)") % from % from_head).str();
+	const auto &comment = "Merge from " + from + "  (ID " + std::to_string(from_head) + ')';
 
-	const auto commit_id = insert_merge_commit_.exec(to_head, from_head, comment);
+	const auto last_tag_id = graph_.get_last_tag_id(to_head);
+	const auto commit_id = insert_merge_commit_.exec(to_head, from_head, comment, stream_id, last_tag_id);
 
 	update_stream_.exec(commit_id, to);
+
+	graph_.add_commit(commit_id, to_head, from_head, last_tag_id);
+}
+
+std::vector<commit> kitman::read_commits(reader &reader, statement &stmt)
+{
+	std::vector<commit> commits;
+
+	while(stmt.step())
+	{
+		auto &commit = commits.emplace_back(stmt.get_int(0), stmt.get_text(2), stmt.get_text(3));
+
+		commit.merge_from_tag = stmt.get_text(4);
+	}
+
+	load_details(reader, commits);
+
+	return commits;
+}
+
+void kitman::return_reader(std::unique_ptr<reader> reader)
+{
+	reader->db.reset_statements();
+
+	{
+		std::lock_guard lock{readers_mutex_};
+		readers_.emplace_back(std::move(reader));
+	}
+
+	readers_available_.notify_one();
 }
 
 void kitman::prepare_statements()
 {
+	clear_stream_last_tags_.prepare(db_, "UPDATE commits SET last_tag_id = NULL WHERE stream_id = ?");
 	delete_stream_.prepare(db_, "DELETE FROM streams WHERE name = ?");
 
-	delete_tags_.prepare(db_, R"(
-		WITH RECURSIVE in_path(commit_id, tag) AS (
-			SELECT head, NULL FROM streams WHERE name = ?
-			UNION ALL
-			SELECT
-				c.parent, t.name
-			FROM
-				commits c
-				JOIN in_path ip ON (ip.commit_id = c.id)
-				LEFT JOIN tags t on (t.commit_id = c.id)
-		)
-		DELETE FROM tags WHERE name IN (
-			SELECT tag FROM in_path
-		)
-	)");
+	delete_tag_.prepare(db_, "DELETE FROM tags WHERE id = ?");
 
-	insert_commit_.prepare(db_, "INSERT INTO commits (parent, comment) VALUES (?, ?)");
-	insert_commit_file_.prepare(db_, "INSERT INTO commit_files (commit_id, seq, path, is_delete) VALUES (?, ?, ?, ?)");
+	insert_commit_.prepare(db_, "INSERT INTO commits (parent, comment, stream_id, last_tag_id) VALUES (?, ?, ?, NULLIF(?, 0))");
+	insert_commit_files_.prepare(db_, get_insert_commit_files_sql(batch_size).data());
 	insert_create_commit_.prepare(db_, "INSERT INTO commits (merge_from, comment) VALUES (?, ?)");
-	insert_merge_commit_.prepare(db_, "INSERT INTO commits (parent, merge_from, comment) VALUES (?, ?, ?)");
+	insert_merge_commit_.prepare(db_, "INSERT INTO commits (parent, merge_from, comment, stream_id, last_tag_id) VALUES (?, ?, ?, ?, NULLIF(?, 0))");
 	insert_stream_.prepare(db_, "INSERT INTO streams (name, parent, head) VALUES (?, ?, ?)");
 	insert_tag_.prepare(db_, "INSERT INTO tags (name, commit_id) VALUES (?, ?)");
-	insert_tag_for_stream_.prepare(db_, "INSERT INTO tags (name, commit_id) SELECT ?, head FROM streams WHERE name = ?");
 
-	const auto select_commits = R"(
-		WITH sorted_commits AS (
-			WITH RECURSIVE in_path(id) AS (
-				SELECT head FROM streams WHERE name = ?
-				UNION ALL
-				SELECT
-					c.parent
-				FROM
-					commits c
-					JOIN in_path ip ON (ip.id = c.id)
-				WHERE
-					c.parent IS NOT NULL
-			)
-			SELECT
-				c.id, c.parent, c.merge_from, c.comment, c.date
-			FROM
-				in_path ip
-				JOIN commits c ON (c.id = ip.id)
-			ORDER BY
-				c.%1% %2%
-		)
-		SELECT
-			(SELECT COUNT(id) FROM sorted_commits), id, merge_from, comment, date
-		FROM
-			sorted_commits LIMIT ? OFFSET ?
-	)";
+	select_stream_.prepare(db_, "SELECT id, head FROM streams WHERE name = ?");
 
-	select_commits_comment_asc_.prepare(db_, (boost::format(select_commits) % "comment" % "asc").str().data());
-	select_commits_comment_desc_.prepare(db_, (boost::format(select_commits) % "comment" % "desc").str().data());
-	select_commits_id_asc_.prepare(db_, (boost::format(select_commits) % "id" % "asc").str().data());
-	select_commits_id_desc_.prepare(db_, (boost::format(select_commits) % "id" % "desc").str().data());
+	update_commit_last_tag_.prepare(db_, "UPDATE commits SET last_tag_id = ? WHERE id = ?");
+	update_commit_stream_.prepare(db_, "UPDATE commits SET stream_id = ? WHERE id = ?");
+	update_stream_.prepare(db_, "UPDATE streams SET head = ? WHERE name = ?");
+}
 
-	select_commit_files_.prepare(db_, "SELECT path, is_delete FROM commit_files WHERE commit_id = ? ORDER BY seq");
+kitman::reader::reader(const char *db_path, const database_settings &settings)
+	: db{db_path, settings, SQLITE_OPEN_READONLY}
+{
+	std::string batch_params{"?"};
 
-	select_last_tag_.prepare(db_, R"(
-		WITH RECURSIVE in_path(commit_id, tag_id, tag) AS (
-			SELECT ?, NULL, NULL
-			UNION ALL
-			SELECT
-				c.parent, t.id, t.name
-			FROM
-				commits c
-				JOIN in_path ip ON (ip.commit_id = c.id)
-				LEFT JOIN tags t ON (t.commit_id = c.id)
-			WHERE
-				ip.tag IS NULL
-		)
-		SELECT tag FROM in_path WHERE tag IS NOT NULL ORDER BY tag_id DESC LIMIT 1
-	)");
+	for(auto i = 1; i < batch_size; ++i)
+	{
+		batch_params += ", ?";
+	}
 
-	select_paths_.prepare(db_, R"(
-		WITH RECURSIVE in_path(id, parent, merge_from) AS (
-			SELECT
-				id, parent, merge_from
-			FROM
-				commits
-			WHERE
-				id = ?
-			UNION
-			SELECT
-				c.id, c.parent, c.merge_from
-			FROM
-				commits c
-				JOIN in_path ip ON (ip.parent = c.id OR ip.merge_from = c.id)
-		)
+	const auto select_commits = R"(
 		SELECT
-			t.name
+			c.id, c.merge_from, c.comment, c.date, COALESCE(mt.name, '')
 		FROM
-			in_path ip
-			JOIN tags t ON (t.commit_id = ip.id)
-	)");
+			commits c
+			LEFT JOIN commits mc ON (mc.id = c.merge_from)
+			LEFT JOIN tags mt ON (mt.id = mc.last_tag_id)
+		WHERE
+			c.stream_id = (SELECT id FROM streams WHERE name = ?1)%1%
+		ORDER BY
+			%2%
+		%3%
+	)";
 
-	select_path_commits_.prepare(db_, R"(
-		WITH RECURSIVE in_path(id, parent, merge_from) AS (
-			SELECT id, parent, merge_from FROM commits WHERE id = ?
-			UNION
-			SELECT
-				c.id, c.parent, c.merge_from
-			FROM
-				commits c
-				JOIN in_path ip ON (ip.parent = c.id OR ip.merge_from = c.id)
-		)
-		SELECT id, parent, merge_from FROM in_path
-	)");
+	const auto after_comment = " AND (c.comment, c.id) %1% ((SELECT comment FROM commits WHERE id = ?2), ?2)";
+	const auto after_id = " AND c.id %1% ?2";
+	const auto limit = "LIMIT ?2 OFFSET ?3";
+	const auto limit_after = "LIMIT ?3";
 
-	select_stream_.prepare(db_, "SELECT id, head FROM streams WHERE name = ?");
+	select_commits_after_comment_asc.prepare(db, (boost::format(select_commits) % (boost::format(after_comment) % '>') % "c.comment ASC, c.id ASC" % limit_after).str().data());
+	select_commits_after_comment_desc.prepare(db, (boost::format(select_commits) % (boost::format(after_comment) % '<') % "c.comment DESC, c.id DESC" % limit_after).str().data());
+	select_commits_after_id_asc.prepare(db, (boost::format(select_commits) % (boost::format(after_id) % '>') % "c.id ASC" % limit_after).str().data());
+	select_commits_after_id_desc.prepare(db, (boost::format(select_commits) % (boost::format(after_id) % '<') % "c.id DESC" % limit_after).str().data());
+	select_commits_comment_asc.prepare(db, (boost::format(select_commits) % "" % "c.comment ASC, c.id ASC" % limit).str().data());
+	select_commits_comment_desc.prepare(db, (boost::format(select_commits) % "" % "c.comment DESC, c.id DESC" % limit).str().data());
+	select_commits_id_asc.prepare(db, (boost::format(select_commits) % "" % "c.id ASC" % limit).str().data());
+	select_commits_id_desc.prepare(db, (boost::format(select_commits) % "" % "c.id DESC" % limit).str().data());
 
-	select_streams_.prepare(db_, R"(
+	select_batch_files.prepare(db, (boost::format("SELECT commit_id, path, is_delete FROM commit_files WHERE commit_id IN (%1%) ORDER BY commit_id, seq") % batch_params).str().data());
+	select_batch_tags.prepare(db, (boost::format("SELECT commit_id, name FROM tags WHERE commit_id IN (%1%) ORDER BY id") % batch_params).str().data());
+
+	select_stream.prepare(db, "SELECT id, head FROM streams WHERE name = ?");
+
+	select_streams.prepare(db, R"(
 		SELECT
-			s.id, s.name, s.head, ps.name, cs.name
+			s.id, s.name, COALESCE(ht.name, ''), ps.name, cs.name
 		FROM
 			streams s
+			JOIN commits hc ON (hc.id = s.head)
+			LEFT JOIN tags ht ON (ht.id = hc.last_tag_id)
 			LEFT JOIN streams ps ON (ps.id = s.parent)
 			LEFT JOIN streams cs ON (cs.parent = s.id)
 		ORDER BY
 			s.name, cs.name
 	)");
 
-	select_tags_.prepare(db_, "SELECT name FROM tags WHERE commit_id = ? ORDER BY id");
-	select_tag_commit_.prepare(db_, "SELECT commit_id FROM tags WHERE name = ?");
-	update_stream_.prepare(db_, "UPDATE streams SET head = ? WHERE name = ?");
+	select_tag_commit.prepare(db, "SELECT commit_id FROM tags WHERE name = ?");
+}
+
+statement &kitman::reader::get_commits_statement(const std::string &sort, const std::string &order, bool after)
+{
+	if(sort == "comment")
+	{
+		if(order == "asc")
+		{
+			return after ? select_commits_after_comment_asc : select_commits_comment_asc;
+		}
+
+		return after ? select_commits_after_comment_desc : select_commits_comment_desc;
+	}
+
+	if(order == "asc")
+	{
+		return after ? select_commits_after_id_asc : select_commits_id_asc;
+	}
+
+	return after ? select_commits_after_id_desc : select_commits_id_desc;
+}
+
+kitman::reader_lease::reader_lease(kitman &kitman)
+	: kitman_{kitman}, reader_{kitman.borrow_reader()}
+{
+}
+
+kitman::reader &kitman::reader_lease::operator*() const
+{
+	return *reader_;
+}
+
+kitman::reader *kitman::reader_lease::operator->() const
+{
+	return reader_.get();
+}
+
+kitman::reader_lease::~reader_lease()
+{
+	kitman_.return_reader(std::move(reader_));
 }
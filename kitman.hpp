@@ -1,8 +1,18 @@
 #pragma once
 
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
 #include <vector>
 
+#include "commit_graph.hpp"
 #include "db.hpp"
+#include "string_table.hpp"
 
 struct file;
 
@@ -11,7 +21,7 @@ struct commit
 	int id;
 	std::string comment;
 	std::string date;
-	std::vector<std::string> tags;
+	std::vector<std::string_view> tags;
 	std::string merge_from_tag;
 	std::vector<file> files;
 
@@ -23,10 +33,10 @@ struct commit
 
 struct file
 {
-	std::string path;
+	std::string_view path;
 	bool is_delete;
 
-	file(const std::string &path, bool is_delete)
+	file(std::string_view path, bool is_delete)
 		: path{path}, is_delete{is_delete}
 	{
 	}
@@ -48,11 +58,25 @@ struct path_commit
 
 struct script
 {
-	std::string path;
-	std::string comment;
+	std::string_view path;
+	int first_source;
+	int last_source;
+
+	script(std::string_view path, int source)
+		: path{path}, first_source{source}, last_source{source}
+	{
+	}
+};
 
-	script(const std::string &path, const std::string &comment)
-		: path{path}, comment{comment}
+// tag and commit that added or changed a script, next is the script's following entry or -1
+struct script_source
+{
+	std::string_view tag;
+	int commit_id;
+	int next = -1;
+
+	script_source(std::string_view tag, int commit_id)
+		: tag{tag}, commit_id{commit_id}
 	{
 	}
 };
@@ -76,6 +100,7 @@ struct upgrade
 	std::string from;
 	bool is_release;
 	std::vector<script> scripts;
+	std::vector<script_source> sources;
 
 	upgrade(const std::string &from)
 		: from{from}
@@ -98,50 +123,138 @@ struct upgrade_path
 class kitman
 {
 public:
-	explicit kitman(const char *db_path);
+	kitman(const char *db_path, const database_settings &settings, unsigned max_readers);
 
 	void commit_files(const std::string &stream, const std::string &comment, const std::vector<file> &files);
 	void create_stream(const std::string &name, const std::string &parent, const std::string &tag);
 	void create_tag(const std::string &stream, const std::string &tag);
 	void delete_stream(const std::string &name);
-	std::vector<upgrade> get_catalog(const std::string &stream, std::vector<std::string> &paths);
-	int get_commit(const std::string &tag);
-	std::vector<path_commit> get_commits(int head);
+	std::shared_ptr<const std::vector<upgrade>> get_catalog(const std::string &stream, std::vector<std::string> &paths);
 	std::tuple<int, std::vector<commit>> get_commits(const std::string &stream, const std::string &sort, const std::string &order, int page, int page_size);
-	std::vector<file> get_files(int commit_id);
-	int get_head(const std::string &stream);
-	std::string get_last_tag(int commit_id);
+	std::tuple<int, std::vector<commit>> get_commits_after(const std::string &stream, const std::string &sort, const std::string &order, int after, int page_size);
 	std::vector<std::string> get_paths(const std::string &stream);
+	database_settings get_settings();
 	std::vector<stream> get_streams();
-	std::vector<std::string> get_tags(int commit_id);
 	void merge(const std::string &from, const std::string &to);
 
+	// used by catalog_generator while get_catalog holds the read lock
+	int get_commit(const std::string &tag);
+	std::vector<path_commit> get_commits(int head);
+	void get_files(const std::vector<int> &commit_ids, const std::function<void(int, std::string_view, bool)> &on_file);
+	int get_head(const std::string &stream);
+	std::string get_last_tag(int commit_id);
+	std::string_view intern(std::string_view value);
+
 private:
+	struct cached_catalog
+	{
+		int head = 0;
+		std::vector<std::string> paths;
+		std::vector<upgrade> upgrades;
+
+		// whether each upgrade's start commit was reachable from head, only those take new commits when extended
+		std::vector<bool> reachable;
+	};
+
+	struct catalog_entry
+	{
+		std::shared_ptr<const cached_catalog> catalog;
+		std::uint64_t last_use;
+	};
+
+	// read-only connection with its own set of prepared statements
+	struct reader
+	{
+		database db;
+
+		statement select_batch_files;
+		statement select_batch_tags;
+		statement select_commits_after_comment_asc;
+		statement select_commits_after_comment_desc;
+		statement select_commits_after_id_asc;
+		statement select_commits_after_id_desc;
+		statement select_commits_comment_asc;
+		statement select_commits_comment_desc;
+		statement select_commits_id_asc;
+		statement select_commits_id_desc;
+		statement select_stream;
+		statement select_streams;
+		statement select_tag_commit;
+
+		reader(const char *db_path, const database_settings &settings);
+
+		statement &get_commits_statement(const std::string &sort, const std::string &order, bool after);
+	};
+
+	// returns the borrowed reader to the pool when it goes out of scope
+	class reader_lease
+	{
+	public:
+		explicit reader_lease(kitman &kitman);
+
+		reader_lease(const reader_lease &) = delete;
+		reader_lease &operator=(const reader_lease &) = delete;
+
+		reader &operator*() const;
+		reader *operator->() const;
+
+		~reader_lease();
+
+	private:
+		kitman &kitman_;
+		std::unique_ptr<reader> reader_;
+	};
+
+	std::string db_path_;
+	database_settings settings_;
 	database db_;
+	commit_graph graph_;
+
+	// file paths and tags handed out by kitman point here, so they outlive any catalog or commit list
+	string_table strings_;
+	std::map<std::tuple<std::string, std::vector<std::string>>, catalog_entry> catalogs_;
+	std::uint64_t catalogs_use_ = 0;
 
+	std::vector<std::unique_ptr<reader>> readers_;
+	unsigned max_readers_;
+	unsigned open_readers_ = 0;
+
+	std::shared_mutex mutex_;
+	std::mutex catalogs_mutex_;
+	std::mutex readers_mutex_;
+	std::condition_variable readers_available_;
+
+	statement clear_stream_last_tags_;
 	statement delete_stream_;
-	statement delete_tags_;
+	statement delete_tag_;
 	statement insert_commit_;
-	statement insert_commit_file_;
+	statement insert_commit_files_;
 	statement insert_create_commit_;
 	statement insert_merge_commit_;
 	statement insert_stream_;
 	statement insert_tag_;
-	statement insert_tag_for_stream_;
-	statement select_commits_comment_asc_;
-	statement select_commits_comment_desc_;
-	statement select_commits_id_asc_;
-	statement select_commits_id_desc_;
-	statement select_commit_files_;
-	statement select_last_tag_;
-	statement select_paths_;
-	statement select_path_commits_;
 	statement select_stream_;
-	statement select_streams_;
-	statement select_tags_;
-	statement select_tag_commit_;
+	statement update_commit_last_tag_;
+	statement update_commit_stream_;
 	statement update_stream_;
 
+	using migration = void(kitman::*)();
+
+	void add_commit_last_tag_id();
+	void add_commit_stream_id();
+	bool add_column(const char *table, const char *column, const char *definition);
+	std::unique_ptr<reader> borrow_reader();
+	void create_commit_stream_indexes();
+	void create_lookup_indexes();
+	void create_tables();
+	std::vector<upgrade> generate_catalog(int head, std::vector<std::string> &paths, std::vector<bool> &reachable);
 	void init_db();
+	void insert_commit_files(statement &stmt, int commit_id, const std::vector<file> &files, std::size_t first, std::size_t count);
+	void load_details(reader &reader, std::vector<commit> &commits);
+	void load_graph();
 	void prepare_statements();
+	std::vector<commit> read_commits(reader &reader, statement &stmt);
+	void return_reader(std::unique_ptr<reader> reader);
+
+	static std::string get_insert_commit_files_sql(std::size_t count);
 };
@@ -1,6 +1,7 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <thread>
 
 #include <boost/program_options.hpp>
 
@@ -20,16 +21,34 @@ namespace po = boost::program_options;
 int main(int argc, char **argv)
 {
 	std::string db_path;
+	database_settings db_settings;
+	unsigned db_threads;
 	std::string generate_from;
+	std::uint64_t max_body_size;
 	unsigned short port;
+	unsigned threads;
 	std::string web_root;
 
 	po::options_description options{"Options"};
 
 	options.add_options()
 		("db", po::value(&db_path)->default_value("kitman.db"), "database file to use")
-		("port", po::value(&port)->default_value(8080), "port to listen on");
+		("db-threads", po::value(&db_threads)->default_value(std::max(1u, std::thread::hardware_concurrency())), "number of threads running database work")
+		("max-body-size", po::value(&max_body_size)->default_value(16 * 1024 * 1024), "largest request body accepted, in bytes")
+		("port", po::value(&port)->default_value(8080), "port to listen on")
+		("threads", po::value(&threads)->default_value(std::max(1u, std::thread::hardware_concurrency())), "number of threads serving requests");
 
+	po::options_description sqlite_options{"SQLite options"};
+
+	sqlite_options.add_options()
+		("cache-size", po::value(&db_settings.cache_size)->default_value(db_settings.cache_size), "page cache size of the writer connection (pages, or KiB when negative)")
+		("journal-mode", po::value(&db_settings.journal_mode)->default_value(db_settings.journal_mode), "journal mode (DELETE, TRUNCATE, PERSIST, MEMORY, WAL or OFF)")
+		("mmap-size", po::value(&db_settings.mmap_size)->default_value(db_settings.mmap_size), "maximum bytes of the database file to memory-map")
+		("reader-cache-size", po::value(&db_settings.reader_cache_size)->default_value(db_settings.reader_cache_size), "page cache size of each of the --db-threads read-only connections (pages, or KiB when negative)")
+		("synchronous", po::value(&db_settings.synchronous)->default_value(db_settings.synchronous), "synchronous mode (OFF, NORMAL, FULL or EXTRA)")
+		("temp-store", po::value(&db_settings.temp_store)->default_value(db_settings.temp_store), "temporary storage (DEFAULT, FILE or MEMORY)");
+
+	options.add(sqlite_options);
 
 	po::options_description hidden_options;
 
@@ -60,7 +79,7 @@ int main(int argc, char **argv)
 				continue;
 			}
 
-			kitman kitman{it->path().string().c_str()};
+			kitman kitman{it->path().string().c_str(), db_settings, 1};
 
 			for(const auto &stream : kitman.get_streams())
 			{
@@ -69,7 +88,7 @@ int main(int argc, char **argv)
 				auto path = it->path();
 
 				std::ofstream out{path.replace_extension(stream.name + ".xml"), std::ios_base::binary};
-				out << upgrades;
+				out << *upgrades;
 			}
 		}
 
@@ -81,7 +100,14 @@ int main(int argc, char **argv)
 		return shell_main(1, argv);
 	}
 
-	asio::io_context io;
+	if(!threads || !db_threads)
+	{
+		std::cout << "Usage: kitman [options]\n\n" << options << "\nthreads and db-threads must be at least 1\n";
+		return EXIT_FAILURE;
+	}
+
+	asio::io_context io{static_cast<int>(threads)};
+	asio::thread_pool db_pool{db_threads};
 	asio::signal_set signals{io, SIGINT, SIGTERM};
 
 	signals.async_wait([&io](const std::error_code &, int)
@@ -89,15 +115,34 @@ int main(int argc, char **argv)
 		io.stop();
 	});
 
-	kitman kitman{db_path.data()};
+	kitman kitman{db_path.data(), db_settings, db_threads};
 
-	http_listener http_listener{io, port, web_root, kitman};
+	http_listener http_listener{io, db_pool, port, max_body_size, web_root, kitman};
 	http_listener.run();
 
-	std::cout << "Listening on port " << port << ", using " << db_path << " as database.\n";
+	std::cout << "Listening on port " << port << " with " << threads << " thread(s) and " << db_threads << " database thread(s), using " << db_path << " as database.\n";
+	std::cout << "SQLite settings: " << kitman.get_settings() << ".\n";
 	std::cout << "Press Ctrl-C to stop.\n";
 
+	std::vector<std::thread> workers;
+
+	for(auto i = 1u; i < threads; ++i)
+	{
+		workers.emplace_back([&io]
+		{
+			io.run();
+		});
+	}
+
 	io.run();
 
+	for(auto &worker : workers)
+	{
+		worker.join();
+	}
+
+	db_pool.stop();
+	db_pool.join();
+
 	return EXIT_SUCCESS;
 }
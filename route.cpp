@@ -0,0 +1,35 @@
+#include "route.hpp"
+
+bool match_route(std::string_view pattern, std::string_view path, std::string_view &stream)
+{
+	constexpr std::string_view stream_param = "{stream}";
+
+	while(!pattern.empty())
+	{
+		if(pattern.compare(0, stream_param.size(), stream_param) == 0)
+		{
+			const auto segment = path.substr(0, path.find('/'));
+
+			if(segment.empty())
+			{
+				return false;
+			}
+
+			stream = segment;
+
+			pattern.remove_prefix(stream_param.size());
+			path.remove_prefix(segment.size());
+			continue;
+		}
+
+		if(path.empty() || path.front() != pattern.front())
+		{
+			return false;
+		}
+
+		pattern.remove_prefix(1);
+		path.remove_prefix(1);
+	}
+
+	return path.empty();
+}
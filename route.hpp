@@ -0,0 +1,7 @@
+#pragma once
+
+#include <string_view>
+
+// matches a request path without its query string against a route pattern, whose text is compared literally except
+// {stream}, which matches any one non-empty segment and is stored in stream
+bool match_route(std::string_view pattern, std::string_view path, std::string_view &stream);
@@ -0,0 +1,53 @@
+#include "string_table.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+std::string_view string_table::intern(std::string_view value)
+{
+	{
+		std::shared_lock lock{mutex_};
+
+		if(const auto it = strings_.find(value); it != strings_.cend())
+		{
+			return *it;
+		}
+	}
+
+	std::unique_lock lock{mutex_};
+
+	if(const auto it = strings_.find(value); it != strings_.cend())
+	{
+		return *it;
+	}
+
+	return *strings_.emplace(store(value)).first;
+}
+
+std::string_view string_table::store(std::string_view value)
+{
+	// large strings get a block of their own so they don't waste the rest of the current one
+	if(value.size() > block_size / 4)
+	{
+		const auto data = blocks_.emplace_back(std::make_unique<char[]>(value.size())).get();
+
+		std::copy(value.cbegin(), value.cend(), data);
+
+		return {data, value.size()};
+	}
+
+	if(available_ < value.size())
+	{
+		next_ = blocks_.emplace_back(std::make_unique<char[]>(block_size)).get();
+		available_ = block_size;
+	}
+
+	const auto data = next_;
+
+	std::copy(value.cbegin(), value.cend(), data);
+
+	next_ += value.size();
+	available_ -= value.size();
+
+	return {data, value.size()};
+}
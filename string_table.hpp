@@ -0,0 +1,25 @@
+#pragma once
+
+#include <memory>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// stores each distinct string once, handles stay valid for the table's lifetime
+class string_table
+{
+public:
+	std::string_view intern(std::string_view value);
+
+private:
+	static constexpr std::size_t block_size = 64 * 1024;
+
+	std::vector<std::unique_ptr<char[]>> blocks_;
+	char *next_ = nullptr;
+	std::size_t available_ = 0;
+	std::unordered_set<std::string_view> strings_;
+	std::shared_mutex mutex_;
+
+	std::string_view store(std::string_view value);
+};
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#include "fixture.hpp"
+#include "reference_catalog.hpp"
+#include "utils.hpp"
+
+constexpr auto seeds = 10u;
+constexpr auto steps = 200;
+constexpr auto file_count = 60;
+constexpr auto max_streams = 8u;
+constexpr auto reference_interval = 10;
+
+// a tag no commit ever gets, so catalogs also cover upgrades from a missing commit
+const std::string missing_tag = "0.0.0";
+
+static std::string get_catalog(kitman &kitman, const std::string &stream, std::vector<std::string> paths)
+{
+	std::ostringstream out;
+
+	out << *kitman.get_catalog(stream, paths);
+
+	for(const auto &path : paths)
+	{
+		out << path << '\n';
+	}
+
+	return out.str();
+}
+
+static bool check_catalog(const std::string &expected, const std::string &actual, const char *source, const std::string &stream, std::size_t path_count, unsigned seed, int step)
+{
+	if(actual == expected)
+	{
+		return true;
+	}
+
+	std::cerr << "seed " << seed << ", step " << step << ", stream " << stream << ", " << path_count << " paths: " << source << " catalog differs\n"
+		<< "expected:\n" << expected << "actual:\n" << actual;
+
+	return false;
+}
+
+// compares every stream's catalogs as kept and extended by cached with those of a kitman that has none cached yet, and
+// every reference_interval steps those with the reference algorithm's
+static bool check_catalogs(kitman &cached, const temp_db &db, const std::vector<std::string> &streams, const std::vector<std::string> &tags, unsigned seed, int step)
+{
+	auto fresh = open_kitman(db);
+
+	for(const auto &stream : streams)
+	{
+		for(const auto &paths : {std::vector<std::string>{}, tags})
+		{
+			const auto &expected = get_catalog(fresh, stream, paths);
+
+			if(step % reference_interval == 0 || step == steps - 1)
+			{
+				auto reference_paths = paths;
+
+				auto reference = reference_catalog{fresh, stream}.generate(reference_paths);
+
+				for(const auto &path : reference_paths)
+				{
+					reference += path + '\n';
+				}
+
+				if(!check_catalog(reference, expected, "generated", stream, paths.size(), seed, step))
+				{
+					return false;
+				}
+			}
+
+			if(!check_catalog(expected, get_catalog(cached, stream, paths), "cached", stream, paths.size(), seed, step))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool run(const temp_db &db, unsigned seed)
+{
+	db.remove();
+
+	std::mt19937 random{seed};
+
+	const auto chance = [&random](double p)
+	{
+		return std::bernoulli_distribution{p}(random);
+	};
+
+	const auto pick = [&random](std::size_t count)
+	{
+		return std::uniform_int_distribution<std::size_t>{0, count - 1}(random);
+	};
+
+	auto tag_count = 0;
+
+	const auto next_tag = [&tag_count]
+	{
+		++tag_count;
+		return std::to_string(1 + tag_count / 7) + '.' + std::to_string(tag_count % 7) + ".0";
+	};
+
+	auto kitman = open_kitman(db, 2);
+
+	const auto &pool = make_files(kitman, file_count);
+
+	std::vector<std::string> streams{"main"};
+	std::vector<std::string> tags{missing_tag};
+
+	tags.emplace_back(next_tag());
+	create_main_stream(kitman, tags.back());
+
+	for(auto step = 0; step < steps; ++step)
+	{
+		const auto stream = streams[pick(streams.size())];
+		const auto action = std::uniform_real_distribution<>{}(random);
+
+		if(action < 0.6)
+		{
+			std::vector<file> files;
+
+			for(auto count = pick(7); count > 0; --count)
+			{
+				const auto &path = pool[pick(pool.size())].path;
+
+				// a commit lists each path once
+				const auto listed = std::any_of(files.cbegin(), files.cend(), [path](const file &file)
+				{
+					return file.path == path;
+				});
+
+				if(!listed)
+				{
+					files.emplace_back(path, chance(0.2));
+				}
+			}
+
+			kitman.commit_files(stream, "c" + std::to_string(step), files);
+		}
+		else if(action < 0.72 && streams.size() > 1)
+		{
+			auto from = stream;
+
+			while(from == stream)
+			{
+				from = streams[pick(streams.size())];
+			}
+
+			kitman.merge(from, stream);
+		}
+		else if(action < 0.8)
+		{
+			tags.emplace_back(next_tag());
+			kitman.create_tag(stream, tags.back());
+		}
+		else if(action < 0.87 && streams.size() < max_streams)
+		{
+			// some streams start untagged, their catalog then has an upgrade from ""
+			std::string tag;
+
+			if(chance(0.8))
+			{
+				tags.emplace_back(next_tag());
+				tag = tags.back();
+			}
+
+			streams.emplace_back("st" + std::to_string(step));
+			kitman.create_stream(streams.back(), stream, tag);
+		}
+		else if(action < 0.89 && streams.size() > 3 && stream != "main")
+		{
+			kitman.delete_stream(stream);
+			streams.erase(std::find(streams.cbegin(), streams.cend(), stream));
+		}
+
+		if(!check_catalogs(kitman, db, streams, tags, seed, step))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main()
+{
+	const temp_db db{"kitman_catalog_test.db"};
+
+	for(auto seed = 1u; seed <= seeds; ++seed)
+	{
+		if(!run(db, seed))
+		{
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::cout << seeds << " histories checked\n";
+
+	return EXIT_SUCCESS;
+}
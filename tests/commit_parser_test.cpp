@@ -0,0 +1,131 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "commit_parser.hpp"
+#include "kitman.hpp"
+
+struct parse_case
+{
+	std::string body;
+
+	// empty when the body is accepted, otherwise part of the message it's rejected with
+	std::string error;
+
+	// the accepted files, each path prefixed with '-' when it's deleted
+	std::vector<std::string> files;
+};
+
+const parse_case cases[]
+{
+	{R"({"comment": "c", "files": []})", "", {}},
+	{R"({"comment": "c", "files": [{"path": "a.sql"}, {"path": "b.sql", "delete": true}, {"delete": false, "path": "c.sql"}]})", "", {"a.sql", "-b.sql", "c.sql"}},
+	{R"({"files": [{"path": "a.sql"}], "comment": "files before comment"})", "", {"a.sql"}},
+
+	// the body isn't an object
+	{"[]", "the body must be an object", {}},
+	{R"("c")", "the body must be an object", {}},
+	{"1", "the body must be an object", {}},
+	{"null", "the body must be an object", {}},
+
+	// files isn't an array of objects
+	{R"({"comment": "c", "files": {"path": "a.sql"}})", "files must be an array", {}},
+	{R"({"comment": "c", "files": "a.sql"})", "files must be an array", {}},
+	{R"({"comment": "c", "files": ["a.sql"]})", "files must be objects", {}},
+	{R"({"comment": "c", "files": [[]]})", "files must be objects", {}},
+
+	// a file without a path, or with fields of the wrong type
+	{R"({"comment": "c", "files": [{"delete": true}]})", "every file needs a path", {}},
+	{R"({"comment": "c", "files": [{"path": "a.sql"}, {}]})", "every file needs a path", {}},
+	{R"({"comment": "c", "files": [{"path": 1}]})", "path must be a string", {}},
+	{R"({"comment": "c", "files": [{"path": "a.sql", "delete": "yes"}]})", "delete must be a boolean", {}},
+	{R"({"comment": "c", "files": [{"path": "a.sql", "delete": 1}]})", "delete must be a boolean", {}},
+	{R"({"comment": "c", "files": [{"path": "a.sql", "delete": {}}]})", "delete must be a boolean", {}},
+	{R"({"comment": "c", "files": [{"path": "a.sql", "delete": null}]})", "delete must be a boolean", {}},
+
+	// comment missing or not a string
+	{R"({"files": []})", "comment and files are required", {}},
+	{R"({"comment": "c"})", "comment and files are required", {}},
+	{R"({"comment": ["c"], "files": []})", "comment must be a string", {}},
+
+	// unknown keys are skipped at every depth, whatever they hold, and their nested keys never count as known ones
+	{R"({"comment": "c", "files": [], "extra": {"path": 1}})", "", {}},
+	{R"({"comment": "c", "files": [], "extra": {"nested": {"files": "x", "comment": 1}}})", "", {}},
+	{R"({"comment": "c", "files": [], "extra": [{"nested": [{"delete": "yes"}]}]})", "", {}},
+	{R"({"comment": "c", "files": [{"path": "a.sql", "extra": {"path": 1, "delete": "yes"}}]})", "", {"a.sql"}},
+	{R"({"comment": "c", "files": [{"path": "a.sql", "extra": [{"nested": {"path": 1}}]}]})", "", {"a.sql"}},
+
+	// not JSON, rejected with the JSON library's message
+	{"", "syntax error", {}},
+	{R"({"comment": "c", "files": [)", "syntax error", {}},
+	{R"({"comment": "c" "files": []})", "syntax error", {}}
+};
+
+static std::string describe(const std::vector<file> &files)
+{
+	std::string result;
+
+	for(const auto &file : files)
+	{
+		result += (file.is_delete ? " -" : " ") + std::string{file.path};
+	}
+
+	return result;
+}
+
+static bool check(commit_parser &parser, const parse_case &test)
+{
+	const auto ok = parser.parse(test.body);
+
+	if(ok != test.error.empty() || (!ok && parser.get_error().find(test.error) == std::string::npos))
+	{
+		std::cerr << test.body << ": expected " << (test.error.empty() ? "success" : test.error) << ", got " << (ok ? "success" : parser.get_error()) << '\n';
+		return false;
+	}
+
+	if(!ok)
+	{
+		return true;
+	}
+
+	std::string expected;
+
+	for(const auto &path : test.files)
+	{
+		expected += ' ' + path;
+	}
+
+	if(describe(parser.get_files()) != expected)
+	{
+		std::cerr << test.body << ": expected files" << expected << ", got" << describe(parser.get_files()) << '\n';
+		return false;
+	}
+
+	return true;
+}
+
+// parses every case with one parser, as a connection does for its requests, so state left over from a rejected body
+// also shows up, then with a new one and with one cleared in between
+int main()
+{
+	commit_parser reused;
+
+	for(const auto &test : cases)
+	{
+		commit_parser fresh;
+		commit_parser cleared;
+
+		cleared.parse(cases[1].body);
+		cleared.clear();
+
+		if(!check(reused, test) || !check(fresh, test) || !check(cleared, test))
+		{
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::cout << std::size(cases) << " bodies checked\n";
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include "kitman.hpp"
+
+// a database file in the temporary directory, removed along with its WAL files when created and when done
+class temp_db
+{
+public:
+	explicit temp_db(const std::string &name)
+		: path_{(std::filesystem::temp_directory_path() / name).string()}
+	{
+		remove();
+	}
+
+	temp_db(const temp_db &) = delete;
+	temp_db &operator=(const temp_db &) = delete;
+
+	~temp_db()
+	{
+		remove();
+	}
+
+	const char *path() const
+	{
+		return path_.c_str();
+	}
+
+	// the next kitman opened on it starts from an empty database
+	void remove() const
+	{
+		for(const auto suffix : {"", "-shm", "-wal"})
+		{
+			std::filesystem::remove(path_ + suffix);
+		}
+	}
+
+private:
+	std::string path_;
+};
+
+inline kitman open_kitman(const temp_db &db, unsigned max_readers = 1)
+{
+	return {db.path(), {}, max_readers};
+}
+
+inline void create_main_stream(kitman &kitman, const std::string &tag = "1.0.0")
+{
+	kitman.create_stream("main", "", tag);
+}
+
+// files scripts/000000.sql, scripts/000001.sql and so on, their paths interned by kitman
+inline std::vector<file> make_files(kitman &kitman, std::size_t count, bool is_delete = false)
+{
+	std::vector<file> files;
+
+	for(std::size_t i = 0; i < count; ++i)
+	{
+		files.emplace_back(kitman.intern((boost::format("scripts/%1$06d.sql") % i).str()), is_delete);
+	}
+
+	return files;
+}
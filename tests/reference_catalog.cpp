@@ -0,0 +1,280 @@
+#include "reference_catalog.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <sstream>
+#include <unordered_set>
+
+#include "utils.hpp"
+
+reference_catalog::reference_catalog(kitman &kitman, const std::string &stream)
+	: kitman_{kitman}, head_{kitman.get_head(stream)}
+{
+	for(const auto &commit : kitman_.get_commits(head_))
+	{
+		commits_.emplace(commit.id, commit);
+	}
+}
+
+std::string reference_catalog::generate(std::vector<std::string> &paths)
+{
+	const auto &last_tag = kitman_.get_last_tag(head_);
+
+	if(std::find(paths.cbegin(), paths.cend(), last_tag) == paths.cend())
+	{
+		paths.emplace_back(last_tag);
+	}
+
+	sort_tags(paths, last_tag);
+
+	std::vector<reference_upgrade> upgrades;
+	std::vector<int> replay_path;
+
+	for(const auto &from : paths)
+	{
+		const auto commit_id = kitman_.get_commit(from);
+		const auto &shortest_path = get_shortest_path(commit_id);
+
+		replay_path.clear();
+
+		auto path = get_direct_path(commit_id);
+		const auto replay_from = path.size();
+
+		path.insert(path.end(), shortest_path.cbegin() + 1, shortest_path.cend());
+		replay(replay_path, path, replay_from, path.size());
+
+		auto &upgrade = upgrades.emplace_back(reference_upgrade{from, true, {}});
+
+		for(const auto id : replay_path)
+		{
+			update_scripts(upgrade.scripts, id);
+		}
+	}
+
+	upgrades.back().is_release = false;
+
+	return write(upgrades);
+}
+
+std::vector<int> reference_catalog::get_direct_path(int to)
+{
+	std::vector<int> path;
+
+	auto commit_id = to;
+
+	do
+	{
+		path.emplace_back(commit_id);
+		commit_id = commits_[commit_id].parent;
+	}
+	while(commit_id);
+
+	std::reverse(path.begin(), path.end());
+
+	return path;
+}
+
+const std::vector<std::tuple<std::string, bool>> &reference_catalog::get_files(int commit_id)
+{
+	auto it = files_.find(commit_id);
+
+	if(it == files_.cend())
+	{
+		it = files_.emplace(commit_id, std::vector<std::tuple<std::string, bool>>{}).first;
+
+		kitman_.get_files({commit_id}, [&files = it->second](int, std::string_view path, bool is_delete)
+		{
+			files.emplace_back(path, is_delete);
+		});
+	}
+
+	return it->second;
+}
+
+const std::string &reference_catalog::get_last_tag(int commit_id)
+{
+	auto it = tags_.find(commit_id);
+
+	if(it == tags_.cend())
+	{
+		const auto &tag = kitman_.get_last_tag(commit_id);
+		it = tags_.emplace(commit_id, tag.empty() ? "DELETED" : tag).first;
+	}
+
+	return it->second;
+}
+
+std::vector<int> reference_catalog::get_shortest_path(int commit_id)
+{
+	std::unordered_map<int, int> from_to;
+	std::unordered_set<int> visited;
+	std::queue<int> work;
+
+	work.emplace(head_);
+
+	while(!work.empty())
+	{
+		const auto commit = commits_[work.front()];
+		work.pop();
+
+		if(!visited.emplace(commit.id).second)
+		{
+			continue;
+		}
+
+		if(commit.parent)
+		{
+			from_to[commit.parent] = commit.id;
+			work.emplace(commit.parent);
+		}
+
+		if(commit.merge_from)
+		{
+			from_to[commit.merge_from] = commit.id;
+			work.emplace(commit.merge_from);
+		}
+
+		if(from_to.find(commit_id) != from_to.cend())
+		{
+			break;
+		}
+	}
+
+	std::vector<int> path;
+
+	do
+	{
+		path.emplace_back(commit_id);
+		commit_id = from_to[commit_id];
+	}
+	while(commit_id);
+
+	return path;
+}
+
+void reference_catalog::merge(std::vector<int> &replay_path, const std::vector<int> &from_path, const std::vector<int> &to_path, std::size_t current_index)
+{
+	for(auto i = static_cast<int>(from_path.size()) - 2; i >= 0; --i)
+	{
+		for(auto j = static_cast<int>(current_index) - 1; j >= 0; --j)
+		{
+			if(commits_[to_path[j]].merge_from == from_path[i])
+			{
+				replay(replay_path, from_path, i + 1, from_path.size());
+				return;
+			}
+		}
+	}
+
+	replay(replay_path, from_path, 1, from_path.size());
+}
+
+void reference_catalog::replay(std::vector<int> &replay_path, const std::vector<int> &path, std::size_t from_index, std::size_t to_index)
+{
+	for(auto current_index = from_index; current_index < to_index; ++current_index)
+	{
+		const auto commit = commits_[path[current_index]];
+
+		if(commit.merge_from)
+		{
+			if(current_index > 0 && commit.merge_from == path[current_index - 1])
+			{
+				auto merge_from_path = get_direct_path(commit.id);
+				merge(replay_path, merge_from_path, path, current_index);
+
+				const auto merge_from_index = merge_from_path.size();
+				merge_from_path.insert(merge_from_path.end(), path.cbegin() + current_index + 1, path.cend());
+
+				replay(replay_path, merge_from_path, merge_from_index, merge_from_path.size());
+				return;
+			}
+
+			if(std::find(replay_path.cbegin(), replay_path.cend(), commit.merge_from) == replay_path.cend())
+			{
+				merge(replay_path, get_direct_path(commit.merge_from), path, current_index);
+			}
+		}
+
+		replay_path.emplace_back(commit.id);
+	}
+}
+
+void reference_catalog::update_scripts(std::vector<reference_script> &scripts, int commit_id)
+{
+	const auto &files = get_files(commit_id);
+
+	if(files.empty())
+	{
+		return;
+	}
+
+	const auto &tag = get_last_tag(commit_id);
+
+	for(const auto &[path, is_delete] : files)
+	{
+		const auto it = std::find_if(scripts.begin(), scripts.end(), [&path = path](const reference_script &script)
+		{
+			return script.path == path;
+		});
+
+		if(is_delete)
+		{
+			if(it != scripts.end())
+			{
+				scripts.erase(it);
+			}
+		}
+		else if(it == scripts.end())
+		{
+			scripts.push_back({path, "from " + tag + " (ID " + std::to_string(commit_id) + ')'});
+		}
+		else
+		{
+			it->comment += ", " + tag + " (ID " + std::to_string(commit_id) + ')';
+		}
+	}
+}
+
+std::string reference_catalog::write(const std::vector<reference_upgrade> &upgrades)
+{
+	std::ostringstream stream;
+
+	stream << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+	stream << "<upgrades>\n";
+
+	for(std::size_t i = 0; i < upgrades.size(); ++i)
+	{
+		const auto &upgrade = upgrades[i];
+
+		if(i > 0)
+		{
+			stream << '\n';
+		}
+
+		stream << "\t<upgrade from=\"" << upgrade.from << "\" release=\"" << std::boolalpha << upgrade.is_release << "\">\n";
+
+		std::string last_comment;
+
+		for(const auto &script : upgrade.scripts)
+		{
+			if(script.comment != last_comment)
+			{
+				if(!last_comment.empty())
+				{
+					stream << '\n';
+				}
+
+				last_comment = script.comment;
+				stream << "\t\t<!-- " << script.comment << " -->\n";
+			}
+
+			stream << "\t\t<script>" << script.path << "</script>\n";
+		}
+
+		stream << "\t</upgrade>\n";
+	}
+
+	stream << "</upgrades>\n";
+
+	return stream.str();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "kitman.hpp"
+
+// kitman's original catalog algorithm, kept as simple as it was to check catalog_generator against: a breadth-first search
+// from head for every upgrade path and a replay that looks merges up in the commits replayed so far
+class reference_catalog
+{
+public:
+	reference_catalog(kitman &kitman, const std::string &stream);
+
+	// returns the catalog XML, adding head's last tag to paths and sorting them like kitman::get_catalog
+	std::string generate(std::vector<std::string> &paths);
+
+private:
+	struct reference_script
+	{
+		std::string path;
+		std::string comment;
+	};
+
+	struct reference_upgrade
+	{
+		std::string from;
+		bool is_release;
+		std::vector<reference_script> scripts;
+	};
+
+	kitman &kitman_;
+	int head_;
+
+	std::unordered_map<int, path_commit> commits_;
+	std::unordered_map<int, std::vector<std::tuple<std::string, bool>>> files_;
+	std::unordered_map<int, std::string> tags_;
+
+	std::vector<int> get_direct_path(int to);
+	const std::vector<std::tuple<std::string, bool>> &get_files(int commit_id);
+	const std::string &get_last_tag(int commit_id);
+	std::vector<int> get_shortest_path(int commit_id);
+
+	void merge(std::vector<int> &replay_path, const std::vector<int> &from_path, const std::vector<int> &to_path, std::size_t current_index);
+	void replay(std::vector<int> &replay_path, const std::vector<int> &path, std::size_t from_index, std::size_t to_index);
+	void update_scripts(std::vector<reference_script> &scripts, int commit_id);
+
+	static std::string write(const std::vector<reference_upgrade> &upgrades);
+};
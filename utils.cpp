@@ -1,9 +1,26 @@
 #include "utils.hpp"
 
 #include <algorithm>
+#include <charconv>
 
 #include "kitman.hpp"
 
+static bool same_sources(const std::vector<script_source> &sources, const script &x, const script &y)
+{
+	auto x_source = x.first_source;
+	auto y_source = y.first_source;
+
+	for(; x_source >= 0 && y_source >= 0; x_source = sources[x_source].next, y_source = sources[y_source].next)
+	{
+		if(sources[x_source].commit_id != sources[y_source].commit_id || sources[x_source].tag != sources[y_source].tag)
+		{
+			return false;
+		}
+	}
+
+	return x_source == y_source;
+}
+
 std::tuple<int, const char *> get_version(const char *tag)
 {
 	auto version = 0;
@@ -88,51 +105,93 @@ void sort_tags(std::vector<std::string> &tags, const std::string &last_tag)
 
 std::ostream &operator<<(std::ostream &stream, const std::vector<upgrade> &upgrades)
 {
-	stream << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
-	stream << "<upgrades>\n";
+	std::string xml;
 
-	auto first_upgrade = true;
+	write_catalog_begin(xml);
 
-	for(const auto &upgrade : upgrades)
+	for(std::size_t i = 0; i < upgrades.size(); ++i)
 	{
-		if(first_upgrade)
-		{
-			first_upgrade = false;
-		}
-		else
+		write_upgrade(xml, upgrades[i], i == 0);
+	}
+
+	write_catalog_end(xml);
+
+	return stream << xml;
+}
+
+void write_catalog_begin(std::string &xml)
+{
+	xml += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+	xml += "<upgrades>\n";
+}
+
+void write_catalog_end(std::string &xml)
+{
+	xml += "</upgrades>\n";
+}
+
+std::size_t write_upgrade(std::string &xml, const upgrade &upgrade, bool first, std::size_t next, std::size_t max_size)
+{
+	if(next == 0)
+	{
+		if(!first)
 		{
-			stream << '\n';
+			xml += '\n';
 		}
 
-		stream << "\t<upgrade from=\"" << upgrade.from << "\" release=\"" << std::boolalpha << upgrade.is_release << "\">\n";
+		xml += "\t<upgrade from=\"";
+		xml += upgrade.from;
+		xml += "\" release=\"";
+		xml += upgrade.is_release ? "true" : "false";
+		xml += "\">\n";
+	}
+
+	const auto &scripts = upgrade.scripts;
+	const auto first_script = next;
 
-		auto first_comment = true;
-		std::string last_comment;
+	// a script's comment group depends only on the script before it, so writing can resume at any script
+	for(; next < scripts.size() && (next == first_script || xml.size() < max_size); ++next)
+	{
+		const auto &script = scripts[next];
+		const auto last_script = next > 0 ? &scripts[next - 1] : nullptr;
 
-		for(const auto &script : upgrade.scripts)
+		if(!last_script || !same_sources(upgrade.sources, script, *last_script))
 		{
-			if(script.comment != last_comment)
+			if(last_script)
 			{
-				if(first_comment)
-				{
-					first_comment = false;
-				}
-				else
+				xml += '\n';
+			}
+
+			xml += "\t\t<!-- from ";
+
+			for(auto source = script.first_source; source >= 0; source = upgrade.sources[source].next)
+			{
+				if(source != script.first_source)
 				{
-					stream << '\n';
+					xml += ", ";
 				}
 
-				last_comment = script.comment;
-				stream << "\t\t<!-- " << script.comment << " -->\n";
+				xml += upgrade.sources[source].tag;
+				char commit_id[16];
+				const auto end = std::to_chars(commit_id, commit_id + sizeof(commit_id), upgrade.sources[source].commit_id).ptr;
+
+				xml += " (ID ";
+				xml.append(commit_id, end);
+				xml += ')';
 			}
 
-			stream << "\t\t<script>" << script.path << "</script>\n";
+			xml += " -->\n";
 		}
 
-		stream << "\t</upgrade>\n";
+		xml += "\t\t<script>";
+		xml += script.path;
+		xml += "</script>\n";
 	}
 
-	stream << "</upgrades>\n";
+	if(next == scripts.size())
+	{
+		xml += "\t</upgrade>\n";
+	}
 
-	return stream;
+	return next;
 }
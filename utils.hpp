@@ -9,4 +9,12 @@ struct upgrade;
 std::tuple<int, const char *> get_version(const char *tag);
 void sort_tags(std::vector<std::string> &tags, const std::string &last_tag = "");
 
+// writes the catalog XML in pieces, write_upgrade's first tells whether upgrade is the first one
+void write_catalog_begin(std::string &xml);
+void write_catalog_end(std::string &xml);
+
+// writes upgrade's scripts from next on, stopping after the script that brings xml to max_size, and returns the script
+// to resume with; next == 0 starts with the opening tag, the closing tag follows the last script, which returns scripts.size()
+std::size_t write_upgrade(std::string &xml, const upgrade &upgrade, bool first, std::size_t next = 0, std::size_t max_size = std::string::npos);
+
 std::ostream &operator<<(std::ostream &stream, const std::vector<upgrade> &upgrades);